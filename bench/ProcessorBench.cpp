@@ -0,0 +1,398 @@
+// Microbenchmarks for the 65EL02 core. Each group loads a synthetic
+// program straight into processor memory and runs it unthrottled, once
+// interpreted and once translated, reporting the time per instruction.
+// Needs no SFML and no disk image.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "computer/Processor.h"
+#include "computer/RedbusDevice.h"
+#include "computer/RedbusNetwork.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint8_t> Code;
+
+constexpr uint16_t codeAddress = 0x0400;
+constexpr uint8_t benchDeviceAddress = 0x02;
+constexpr uint8_t otherDeviceAddress = 0x03;
+constexpr unsigned cyclesPerTick = 100 * 1000;
+constexpr unsigned warmupTicks = 20;
+
+// CLC, XCE, REP #$30: native mode with 16-bit A, X and Y like the
+// Forth system uses. Groups without it run in emulation mode.
+Code const nativeMode = {0x18, 0xfb, 0xc2, 0x30};
+
+// A program runs setup once, then loops over body repeated a number of
+// times. Data is copied to memory before it starts.
+struct Group {
+	char const * name;
+	Code setup;
+	Code body;
+	unsigned repeat;
+	std::vector<std::pair<uint16_t, Code>> data;
+	bool deviceSwitchYields = true;
+};
+
+Code operator+(Code a, Code const & b)
+{
+	a.insert(a.end(), b.begin(), b.end());
+	return a;
+}
+
+Code word(uint16_t value)
+{
+	return {uint8_t(value), uint8_t(value >> 8)};
+}
+
+std::vector<Group> buildGroups()
+{
+	std::vector<Group> groups;
+
+	// The 8-bit ALU lacks ADC and SBC
+	groups.push_back({"alu8", {},
+		{
+			0x18,       // CLC
+			0x38,       // SEC
+			0x29, 0x7f, // AND #$7f
+			0x09, 0x10, // ORA #$10
+			0x49, 0x55, // EOR #$55
+			0xc9, 0x20, // CMP #$20
+			0x1a,       // INC A
+			0x2a,       // ROL A
+			0x3a,       // DEC A
+			0x6a        // ROR A
+		}, 16, {}});
+
+	groups.push_back({"alu16", nativeMode,
+		{
+			0x18,             // CLC
+			0x69, 0x34, 0x12, // ADC #$1234
+			0x29, 0xff, 0x7f, // AND #$7fff
+			0x09, 0x10, 0x00, // ORA #$0010
+			0x49, 0x55, 0x55, // EOR #$5555
+			0xc9, 0x00, 0x20, // CMP #$2000
+			0x1a,             // INC A
+			0x2a,             // ROL A
+			0x3a,             // DEC A
+			0x6a              // ROR A
+		}, 16, {}});
+
+	groups.push_back({"memory", nativeMode,
+		{
+			0xa5, 0x10,       // LDA $10
+			0x85, 0x11,       // STA $11
+			0xad, 0x00, 0x03, // LDA $0300
+			0x8d, 0x01, 0x03, // STA $0301
+			0xe6, 0x12,       // INC $12
+			0x65, 0x13,       // ADC $13
+			0x64, 0x14,       // STZ $14
+			0xee, 0x02, 0x03  // INC $0302
+		}, 16, {}});
+
+	groups.push_back({"indexed", nativeMode
+			+ Code{0xa2, 0x04, 0x00}  // LDX #$0004
+			+ Code{0xa0, 0x02, 0x00}, // LDY #$0002
+		{
+			0xb5, 0x10,       // LDA $10,X
+			0x95, 0x18,       // STA $18,X
+			0x7d, 0x00, 0x03, // ADC $0300,X
+			0x79, 0x00, 0x03, // ADC $0300,Y
+			0x9d, 0x10, 0x03, // STA $0310,X
+			0x99, 0x20, 0x03, // STA $0320,Y
+			0x71, 0x20,       // ADC ($20),Y
+			0x91, 0x20,       // STA ($20),Y
+			0xa1, 0x20,       // LDA ($20,X)
+			0x72, 0x20,       // ADC ($20)
+			0xa3, 0x01,       // LDA $01,S
+			0x67, 0x01,       // ADC $01,R
+			0x87, 0x04        // STA $04,R
+		}, 16, {{0x20, word(0x0300)}, {0x24, word(0x0310)}}});
+
+	groups.push_back({"stack", nativeMode,
+		{
+			0x48,             // PHA
+			0x68,             // PLA
+			0xda,             // PHX
+			0xfa,             // PLX
+			0x5a,             // PHY
+			0x7a,             // PLY
+			0x4b,             // RHA
+			0x6b,             // RLA
+			0x0b,             // RHI
+			0x2b,             // RLI
+			0xf4, 0x34, 0x12, // PEA $1234
+			0x68              // PLA
+		}, 16, {}});
+
+	// Direct threaded code like the Forth inner interpreter: a thread of
+	// colon words, each entering a thread of primitives and leaving
+	// through EXIT. The last word of the main thread starts it over.
+	uint16_t const thread = 0x0800;
+	uint16_t const colonWord = 0x0600;
+	uint16_t const nextWord = 0x0610;
+	uint16_t const incWord = 0x0620;
+	uint16_t const exitWord = 0x0630;
+	uint16_t const loopWord = 0x0640;
+	uint16_t const start = codeAddress + nativeMode.size();
+
+	Code mainThread;
+	for (unsigned i = 0; i < 16; ++i) {
+		mainThread = mainThread + word(colonWord);
+	}
+	mainThread = mainThread + word(loopWord);
+
+	groups.push_back({"threading", nativeMode,
+		Code{0xa2} + word(thread) // LDX #thread
+			+ Code{0x5c, 0x02},   // TXI, NXT
+		1,
+		{
+			{thread, mainThread},
+			// ENT next, followed by the colon word's thread
+			{colonWord, Code{0x22} + word(nextWord) + word(incWord) + word(incWord) + word(exitWord)},
+			{nextWord, {0x02}},                 // NXT
+			{incWord, {0x1a, 0x02}},            // INC A, NXT
+			{exitWord, {0x2b, 0x02}},           // RLI, NXT
+			{loopWord, Code{0x4c} + word(start)} // JMP start
+		}});
+
+	groups.push_back({"muldiv", nativeMode,
+		{
+			0xa9, 0x23, 0x01, // LDA #$0123
+			0x18,             // CLC
+			0x0f, 0x10,       // MUL $10
+			0x18,             // CLC
+			0x4f, 0x12        // DIV $12
+		}, 16, {{0x10, word(0x0017)}, {0x12, word(0x0005)}}});
+
+	groups.push_back({"redbus", nativeMode
+			+ Code{0xa9} + word(benchDeviceAddress) + Code{0xef, 0x00} // LDA #device, MMU $00
+			+ Code{0xa9} + word(0x0300) + Code{0xef, 0x01}             // LDA #$0300, MMU $01
+			+ Code{0xef, 0x02},                                        // MMU $02
+		{
+			0xad, 0x00, 0x03, // LDA $0300
+			0x8d, 0x02, 0x03, // STA $0302
+			0xad, 0x04, 0x03, // LDA $0304
+			0x8d, 0x06, 0x03  // STA $0306
+		}, 16, {}});
+
+	// Alternates between two devices like Forth code talking to the
+	// console and the disk, once ending the tick on every switch and
+	// once carrying on
+	Code const redbusSetup = nativeMode
+		+ Code{0xa9} + word(0x0300) + Code{0xef, 0x01} // LDA #$0300, MMU $01
+		+ Code{0xef, 0x02};                            // MMU $02
+	Code const switchBody = Code{0xa9} + word(benchDeviceAddress) // LDA #device
+		+ Code{0xef, 0x00}                                        // MMU $00
+		+ Code{0xad, 0x00, 0x03}                                  // LDA $0300
+		+ Code{0xa9} + word(otherDeviceAddress)                   // LDA #other
+		+ Code{0xef, 0x00}                                        // MMU $00
+		+ Code{0xad, 0x00, 0x03};                                 // LDA $0300
+
+	groups.push_back({"switch", redbusSetup, switchBody, 16, {}});
+	groups.push_back({"switchfast", redbusSetup, switchBody, 16, {}, false});
+
+	return groups;
+}
+
+// Plain memory on the Redbus for the window accesses
+class BenchDevice : public RedbusDevice
+{
+public:
+	BenchDevice(RedbusNetwork & network, uint8_t address) :
+		RedbusDevice(network, address),
+		memory()
+	{}
+
+	uint8_t read(uint8_t address) override { return memory[address]; };
+	void write(uint8_t address, uint8_t value) override { memory[address] = value; };
+
+	void mapMemory(MemoryMap & map) override
+	{
+		for (unsigned i = 0; i < memory.size(); ++i) {
+			map[i] = &memory[i];
+		}
+	};
+private:
+	std::array<uint8_t, 256> memory;
+};
+
+std::shared_ptr<uint8_t> buildImage(Group const & group)
+{
+	std::shared_ptr<uint8_t> image(new uint8_t[Processor::memorySize](), std::default_delete<uint8_t[]>());
+
+	Code program = group.setup;
+	uint16_t const loop = codeAddress + program.size();
+	for (unsigned i = 0; i < group.repeat; ++i) {
+		program = program + group.body;
+	}
+	program = program + Code{0x4c} + word(loop); // JMP loop
+
+	std::copy(program.begin(), program.end(), image.get() + codeAddress);
+	for (auto const & data : group.data) {
+		std::copy(data.second.begin(), data.second.end(), image.get() + data.first);
+	}
+
+	return image;
+}
+
+struct Result {
+	std::string group;
+	std::string engine;
+	uint64_t instructions;
+	double seconds;
+};
+
+// Returns false if the engine is not supported on this host
+bool runGroup(Group const & group, bool useJit, Clock::duration duration, Result & result)
+{
+	RedbusNetwork net;
+	BenchDevice device(net, benchDeviceAddress);
+	BenchDevice otherDevice(net, otherDeviceAddress);
+	Processor processor(net, 8, 0x00);
+
+	if (!processor.setJitEnabled(useJit)) {
+		return false;
+	}
+	processor.setClock(cyclesPerTick, Processor::ClockMode::Fast);
+	processor.setDeviceSwitchYields(group.deviceSwitchYields);
+	processor.setMemory(buildImage(group));
+	processor.warmBoot();
+
+	for (unsigned i = 0; i < warmupTicks; ++i) {
+		processor.runTick();
+	}
+
+	uint64_t const startInstructions = processor.getInstructionCount();
+	Clock::time_point const start = Clock::now();
+	Clock::time_point now = start;
+	while (now - start < duration && !processor.isHalted()) {
+		processor.runTick();
+		now = Clock::now();
+	}
+
+	if (processor.isHalted()) {
+		throw std::runtime_error(std::string("Benchmark ") + group.name + " halted the processor");
+	}
+
+	result.group = group.name;
+	result.engine = useJit ? "jit" : "interpreter";
+	result.instructions = processor.getInstructionCount() - startInstructions;
+	result.seconds = std::chrono::duration<double>(now - start).count();
+	return true;
+}
+
+double nsPerInstruction(Result const & result)
+{
+	return result.seconds * 1e9 / result.instructions;
+}
+
+double mips(Result const & result)
+{
+	return result.instructions / result.seconds / 1e6;
+}
+
+void printTable(std::vector<Result> const & results)
+{
+	std::cout << std::fixed << std::setprecision(2)
+		<< "Group      Engine        Instructions  ns/instr     MIPS\n";
+
+	for (auto const & result : results) {
+		std::cout << std::left << std::setw(11) << result.group
+			<< std::setw(12) << result.engine << std::right
+			<< std::setw(14) << result.instructions
+			<< std::setw(10) << nsPerInstruction(result)
+			<< std::setw(9) << mips(result) << "\n";
+	}
+	std::cout << std::flush;
+}
+
+// One JSON object per line, see docs/benchmark.md
+void writeJson(std::vector<Result> const & results, std::string const & filename)
+{
+	std::ofstream out(filename);
+	if (!out) {
+		throw std::runtime_error("Unable to open " + filename);
+	}
+
+	out << std::setprecision(6);
+	for (auto const & result : results) {
+		out << "{\"group\": \"" << result.group << "\""
+			<< ", \"engine\": \"" << result.engine << "\""
+			<< ", \"instructions\": " << result.instructions
+			<< ", \"seconds\": " << result.seconds
+			<< ", \"ns_per_instruction\": " << nsPerInstruction(result)
+			<< ", \"mips\": " << mips(result) << "}\n";
+	}
+}
+
+void printUsage(std::string const & program) {
+	std::cout << "Usage:\n     " << program << " [options]\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "     --ms <ms>             Time to run each group and engine (default 200)\n"
+		<< "     --json <file>         Also write the results to file as JSON lines"
+		<< std::endl;
+}
+
+}
+
+int main(int argc, char * argv[]) {
+	std::vector<std::string> const arguments(argv, argv + argc);
+
+	unsigned long ms = 200;
+	std::string jsonFile;
+
+	for (std::size_t i = 1; i < arguments.size(); ++i) {
+		bool const hasValue = i + 1 < arguments.size();
+
+		if (arguments[i] == "--ms" && hasValue) {
+			ms = std::strtoul(arguments[++i].c_str(), nullptr, 10);
+			if (ms == 0) {
+				printUsage(arguments[0]);
+				return 1;
+			}
+		} else if (arguments[i] == "--json" && hasValue) {
+			jsonFile = arguments[++i];
+		} else {
+			printUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	std::vector<Result> results;
+	bool jitSupported = true;
+
+	for (auto const & group : buildGroups()) {
+		for (bool useJit : {false, true}) {
+			Result result;
+			if (runGroup(group, useJit, std::chrono::milliseconds(ms), result)) {
+				results.push_back(result);
+			} else {
+				jitSupported = false;
+			}
+		}
+	}
+
+	if (!jitSupported) {
+		std::cout << "JIT is not supported on this host, only the interpreter was measured" << std::endl;
+	}
+
+	printTable(results);
+	if (!jsonFile.empty()) {
+		writeJson(results, jsonFile);
+	}
+
+	return 0;
+}
@@ -17,3 +17,23 @@ std::vector<uint8_t> loadFile(std::string const & filename)
 
 	return data;
 }
+
+std::size_t getFileSize(std::string const & filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error(
+			std::string("Unable to open file '") + filename + "'");
+	}
+
+	return file.tellg();
+}
+
+void saveFile(std::string const & filename, std::vector<uint8_t> const & data)
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.write(reinterpret_cast<char const *>(data.data()), data.size())) {
+		throw std::runtime_error(
+			std::string("Unable to write file '") + filename + "'");
+	}
+}
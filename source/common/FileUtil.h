@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
 
 std::vector<uint8_t> loadFile(std::string const & filename);
+std::size_t getFileSize(std::string const & filename);
+void saveFile(std::string const & filename, std::vector<uint8_t> const & data);
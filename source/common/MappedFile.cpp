@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EFORTHPC_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<uint8_t> mapFile(std::string const & filename, uint64_t offset, std::size_t size)
+{
+#ifdef EFORTHPC_MMAP
+	int const file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) {
+		throw std::runtime_error(
+			std::string("Unable to open file '") + filename + "'");
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || uint64_t(status.st_size) < offset + size) {
+		close(file);
+		throw std::runtime_error(
+			std::string("File '") + filename + "' is too short");
+	}
+
+	// Mappings start on a page boundary
+	uint64_t const skipped = offset % sysconf(_SC_PAGESIZE);
+	std::size_t const length = size + skipped;
+
+	void * mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, offset - skipped);
+	close(file);
+
+	if (mapping == MAP_FAILED) {
+		throw std::runtime_error(
+			std::string("Unable to map file '") + filename + "'");
+	}
+
+	uint8_t * const start = static_cast<uint8_t *>(mapping);
+	std::shared_ptr<uint8_t> owner(start, [length](uint8_t * address) { munmap(address, length); });
+	return std::shared_ptr<uint8_t>(owner, start + skipped);
+#else
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error(
+			std::string("Unable to open file '") + filename + "'");
+	}
+
+	std::shared_ptr<uint8_t> data(new uint8_t[size], std::default_delete<uint8_t[]>());
+	file.seekg(offset);
+	if (!file.read(reinterpret_cast<char *>(data.get()), size)) {
+		throw std::runtime_error(
+			std::string("File '") + filename + "' is too short");
+	}
+
+	return data;
+#endif
+}
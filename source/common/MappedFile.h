@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Maps size bytes of a file starting at offset as private copy-on-write
+// memory. Pages are read from the file on first access and writes never
+// reach the file. Hosts without mmap read the region instead. Throws
+// std::runtime_error if the file cannot be opened or is too short.
+std::shared_ptr<uint8_t> mapFile(std::string const & filename, uint64_t offset, std::size_t size);
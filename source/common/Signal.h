@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Wakes a thread sleeping on it from any other thread. A notification
+// sent while nobody waits is kept for the next wait, so none is lost.
+class Signal
+{
+public:
+	Signal() :
+		mutex(),
+		condition(),
+		notified(false)
+	{}
+
+	void notify()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			notified = true;
+		}
+		condition.notify_one();
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this] { return notified; });
+		notified = false;
+	}
+
+	// Returns false if the deadline passed without a notification
+	template <typename Clock, typename Duration>
+	bool waitUntil(std::chrono::time_point<Clock, Duration> const & deadline)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		bool const woken = condition.wait_until(lock, deadline, [this] { return notified; });
+		notified = false;
+		return woken;
+	}
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool notified;
+};
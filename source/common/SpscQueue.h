@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded queue for exactly one producer and one consumer
+// thread. Size must be a power of two, one slot is kept free.
+template <typename T, std::size_t Size>
+class SpscQueue
+{
+	static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+public:
+	SpscQueue() :
+		items(),
+		head(0),
+		padding(),
+		tail(0)
+	{}
+
+	// Producer side, returns false if the queue is full
+	bool push(T const & item)
+	{
+		std::size_t const position = tail.load(std::memory_order_relaxed);
+		std::size_t const next = (position + 1) & (Size - 1);
+		if (next == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		items[position] = item;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, returns false if the queue is empty
+	bool pop(T & item)
+	{
+		std::size_t const position = head.load(std::memory_order_relaxed);
+		if (position == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = items[position];
+		head.store((position + 1) & (Size - 1), std::memory_order_release);
+		return true;
+	}
+private:
+	std::array<T, Size> items;
+
+	// Written by the consumer and the producer respectively, padded
+	// apart so they do not share a cache line. Padding rather than
+	// alignas keeps the queue allocatable with plain new in C++14.
+	std::atomic<std::size_t> head;
+	char padding[64 - sizeof(std::atomic<std::size_t>)];
+	std::atomic<std::size_t> tail;
+};
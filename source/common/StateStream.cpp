@@ -0,0 +1,48 @@
+#include "StateStream.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void StateReader::bytes(uint8_t * values, std::size_t count)
+{
+	require(count);
+	std::copy(data + position, data + position + count, values);
+	position += count;
+}
+
+std::vector<uint8_t> StateReader::blob()
+{
+	std::vector<uint8_t> values(u32());
+	bytes(values.data(), values.size());
+	return values;
+}
+
+std::string StateReader::string()
+{
+	std::size_t const length = u32();
+	require(length);
+
+	std::string value(reinterpret_cast<char const *>(data + position), length);
+	position += length;
+	return value;
+}
+
+uint64_t StateReader::integer(unsigned count)
+{
+	require(count);
+
+	uint64_t value = 0;
+	for (unsigned i = 0; i < count; ++i) {
+		value |= uint64_t(data[position + i]) << (8 * i);
+	}
+	position += count;
+
+	return value;
+}
+
+void StateReader::require(std::size_t count) const
+{
+	if (count > size - position) {
+		throw std::runtime_error("Truncated machine state");
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Little-endian serialization of machine state for snapshots.
+class StateWriter
+{
+public:
+	void u8(uint8_t value) { data.push_back(value); }
+	void u16(uint16_t value) { integer(value, 2); }
+	void u32(uint32_t value) { integer(value, 4); }
+	void u64(uint64_t value) { integer(value, 8); }
+	void boolean(bool value) { u8(value ? 1 : 0); }
+
+	void bytes(uint8_t const * values, std::size_t size)
+	{
+		data.insert(data.end(), values, values + size);
+	}
+
+	// Length prefixed
+	void blob(std::vector<uint8_t> const & values)
+	{
+		u32(values.size());
+		bytes(values.data(), values.size());
+	}
+
+	void string(std::string const & value)
+	{
+		u32(value.size());
+		data.insert(data.end(), value.begin(), value.end());
+	}
+
+	std::vector<uint8_t> const & getData() const { return data; }
+private:
+	void integer(uint64_t value, unsigned size)
+	{
+		for (unsigned i = 0; i < size; ++i) {
+			data.push_back(value >> (8 * i));
+		}
+	}
+
+	std::vector<uint8_t> data;
+};
+
+// Reads what StateWriter wrote, throws std::runtime_error when reading
+// past the end.
+class StateReader
+{
+public:
+	StateReader(uint8_t const * data, std::size_t size) :
+		data(data),
+		size(size),
+		position(0)
+	{}
+
+	uint8_t u8() { return integer(1); }
+	uint16_t u16() { return integer(2); }
+	uint32_t u32() { return integer(4); }
+	uint64_t u64() { return integer(8); }
+	bool boolean() { return u8() != 0; }
+
+	void bytes(uint8_t * values, std::size_t count);
+	std::vector<uint8_t> blob();
+	std::string string();
+
+	bool atEnd() const { return position == size; }
+private:
+	uint64_t integer(unsigned count);
+	void require(std::size_t count) const;
+
+	uint8_t const * data;
+	std::size_t size;
+	std::size_t position;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one writer thread to one reader thread
+// without either side waiting: the writer fills a back buffer and swaps
+// it with the shared middle one, the reader swaps the middle one with
+// its front buffer whenever a new value has been published.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() :
+		buffers(),
+		back(0),
+		middle(1),
+		front(2)
+	{}
+
+	// Writer side
+	T & writeBuffer()
+	{
+		return buffers[back];
+	}
+
+	void publish()
+	{
+		back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// Reader side, true if a value was published since the last read
+	bool isFresh() const
+	{
+		return middle.load(std::memory_order_relaxed) & freshBit;
+	}
+
+	// Reader side, returns the latest published value
+	T const & read()
+	{
+		if (middle.load(std::memory_order_relaxed) & freshBit) {
+			front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+		}
+
+		return buffers[front];
+	}
+private:
+	static uint8_t const freshBit = 4;
+	static uint8_t const indexMask = 3;
+
+	std::array<T, 3> buffers;
+
+	uint8_t back;
+	std::atomic<uint8_t> middle;
+	uint8_t front;
+};
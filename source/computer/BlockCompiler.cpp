@@ -0,0 +1,1532 @@
+#include "BlockCompiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define EFORTHPC_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+#include "Processor.h"
+
+namespace {
+
+enum Reg : uint8_t {
+	rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+	r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+// Condition codes of jcc and setcc
+enum Cond : uint8_t {
+	Below = 0x2,
+	AboveEqual = 0x3,
+	Equal = 0x4,
+	NotEqual = 0x5,
+	Above = 0x7,
+	Less = 0xc
+};
+
+// Extensions of the group 1 ALU opcodes
+enum Alu : uint8_t {
+	Add = 0,
+	Or = 1,
+	And = 4,
+	Sub = 5,
+	Xor = 6,
+	Cmp = 7
+};
+
+// Memory operand [base + index * scale + displacement]
+struct Mem {
+	Reg base;
+	int32_t displacement;
+	bool indexed;
+	Reg index;
+	uint8_t scale;
+};
+
+Mem at(Reg base, int32_t displacement = 0)
+{
+	return Mem{base, displacement, false, rax, 1};
+}
+
+Mem at(Reg base, Reg index, uint8_t scale, int32_t displacement = 0)
+{
+	return Mem{base, displacement, true, index, scale};
+}
+
+// Minimal x86-64 machine code writer. Register operations are 32-bit
+// unless named otherwise, which zero-extends into the full register.
+class Emitter
+{
+public:
+	void bytes(std::initializer_list<uint8_t> values)
+	{
+		code.insert(code.end(), values.begin(), values.end());
+	}
+
+	void imm8(uint8_t value) { append(&value, sizeof(value)); }
+	void imm16(uint16_t value) { append(&value, sizeof(value)); }
+	void imm32(uint32_t value) { append(&value, sizeof(value)); }
+	void imm64(uint64_t value) { append(&value, sizeof(value)); }
+
+	void movzx8(Reg dst, Mem const & src) { memory({0x0f, 0xb6}, dst, src); }
+	void movzx16(Reg dst, Mem const & src) { memory({0x0f, 0xb7}, dst, src); }
+	void movzx8(Reg dst, Reg src) { registers({0x0f, 0xb6}, dst, src, false, true); }
+	void movzx16(Reg dst, Reg src) { registers({0x0f, 0xb7}, dst, src); }
+	void load64(Reg dst, Mem const & src) { memory({0x8b}, dst, src, true); }
+
+	void store8(Mem const & dst, Reg src) { memory({0x88}, src, dst, false, true); }
+	void store16(Mem const & dst, Reg src)
+	{
+		bytes({0x66});
+		memory({0x89}, src, dst);
+	}
+
+	void store8(Mem const & dst, uint8_t value)
+	{
+		memory({0xc6}, 0, dst);
+		imm8(value);
+	}
+
+	void store16(Mem const & dst, uint16_t value)
+	{
+		bytes({0x66});
+		memory({0xc7}, 0, dst);
+		imm16(value);
+	}
+
+	void mov(Reg dst, Reg src) { registers({0x89}, src, dst); }
+	void mov64(Reg dst, Reg src) { registers({0x89}, src, dst, true); }
+
+	void mov(Reg dst, uint32_t value)
+	{
+		prefix(false, 0, 0, dst, false);
+		bytes({uint8_t(0xb8 + (dst & 7))});
+		imm32(value);
+	}
+
+	void mov64(Reg dst, uint64_t value)
+	{
+		prefix(true, 0, 0, dst, false);
+		bytes({uint8_t(0xb8 + (dst & 7))});
+		imm64(value);
+	}
+
+	void lea(Reg dst, Mem const & src) { memory({0x8d}, dst, src); }
+
+	void alu(Alu op, Reg dst, Reg src) { registers({uint8_t(op << 3 | 1)}, src, dst); }
+
+	void alu(Alu op, Reg dst, int32_t value)
+	{
+		if (value >= -128 && value < 128) {
+			registers({0x83}, op, dst);
+			imm8(value);
+		} else {
+			registers({0x81}, op, dst);
+			imm32(value);
+		}
+	}
+
+	void alu64(Alu op, Mem const & dst, int32_t value)
+	{
+		if (value >= -128 && value < 128) {
+			memory({0x83}, op, dst, true);
+			imm8(value);
+		} else {
+			memory({0x81}, op, dst, true);
+			imm32(value);
+		}
+	}
+
+	void or8(Reg dst, Reg src) { registers({0x08}, src, dst, false, true); }
+	void or8(Reg dst, Mem const & src) { memory({0x0a}, dst, src, false, true); }
+	void cmp8(Mem const & left, Reg right) { memory({0x38}, right, left, false, true); }
+	void cmp64(Reg left, Mem const & right) { memory({0x3b}, left, right, true); }
+
+	void cmp8(Reg left, uint8_t value)
+	{
+		registers({0x80}, Cmp, left, false, true);
+		imm8(value);
+	}
+
+	void cmp8(Mem const & left, uint8_t value)
+	{
+		memory({0x80}, Cmp, left);
+		imm8(value);
+	}
+
+	void cmp16(Mem const & left, uint8_t value)
+	{
+		bytes({0x66});
+		memory({0x83}, Cmp, left);
+		imm8(value);
+	}
+
+	void test(Reg left, Reg right) { registers({0x85}, right, left); }
+	void test64(Reg left, Reg right) { registers({0x85}, right, left, true); }
+
+	void test(Reg left, uint32_t value)
+	{
+		registers({0xf7}, 0, left);
+		imm32(value);
+	}
+
+	void test8(Mem const & left, uint8_t value)
+	{
+		memory({0xf6}, 0, left);
+		imm8(value);
+	}
+
+	void shl(Reg dst, uint8_t count) { registers({0xc1}, 4, dst); imm8(count); }
+	void shr(Reg dst, uint8_t count) { registers({0xc1}, 5, dst); imm8(count); }
+	void neg(Reg dst) { registers({0xf7}, 3, dst); }
+
+	void set(Cond condition, Reg dst) { registers({0x0f, uint8_t(0x90 | condition)}, 0, dst, false, true); }
+	void set(Cond condition, Mem const & dst) { memory({0x0f, uint8_t(0x90 | condition)}, 0, dst); }
+
+	void push(Reg reg)
+	{
+		prefix(false, 0, 0, reg, false);
+		bytes({uint8_t(0x50 + (reg & 7))});
+	}
+
+	void pop(Reg reg)
+	{
+		prefix(false, 0, 0, reg, false);
+		bytes({uint8_t(0x58 + (reg & 7))});
+	}
+
+	void call(Reg target) { registers({0xff}, 2, target); }
+	void jmp(Mem const & target) { memory({0xff}, 4, target); }
+	void ret() { bytes({0xc3}); }
+
+	// jcc/jmp rel32, return the displacement position for patch()
+	std::size_t jump(Cond condition)
+	{
+		bytes({0x0f, uint8_t(0x80 | condition)});
+		std::size_t const position = code.size();
+		imm32(0);
+		return position;
+	}
+
+	std::size_t jump()
+	{
+		bytes({0xe9});
+		std::size_t const position = code.size();
+		imm32(0);
+		return position;
+	}
+
+	void patch(std::size_t position, std::size_t target)
+	{
+		int32_t const displacement = int32_t(target) - int32_t(position + 4);
+		std::memcpy(code.data() + position, &displacement, sizeof(displacement));
+	}
+
+	void patch(std::size_t position) { patch(position, code.size()); }
+
+	std::size_t size() const { return code.size(); }
+
+	std::vector<uint8_t> code;
+private:
+	// REX prefix, also forced for byte accesses to sil, dil, spl, bpl
+	void prefix(bool wide, unsigned reg, unsigned index, unsigned base, bool byteRegisters)
+	{
+		uint8_t const rex = 0x40
+			| (wide ? 8 : 0)
+			| (reg & 8 ? 4 : 0)
+			| (index & 8 ? 2 : 0)
+			| (base & 8 ? 1 : 0);
+		bool const needsRex = byteRegisters
+			&& ((reg >= 4 && reg < 8) || (base >= 4 && base < 8));
+		if (rex != 0x40 || needsRex) {
+			bytes({rex});
+		}
+	}
+
+	// Opcode with a register or opcode extension and a memory operand
+	void memory(std::initializer_list<uint8_t> opcode, unsigned reg, Mem const & m,
+		bool wide = false, bool byteRegister = false)
+	{
+		prefix(wide, reg, m.indexed ? m.index : 0, m.base, byteRegister && reg >= 4 && reg < 8);
+		bytes(opcode);
+
+		uint8_t const base = m.base & 7;
+		uint8_t mode = 2;
+		if (m.displacement == 0 && base != rbp) {
+			mode = 0;
+		} else if (m.displacement >= -128 && m.displacement < 128) {
+			mode = 1;
+		}
+
+		if (m.indexed || base == rsp) {
+			uint8_t const scale = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+			uint8_t const index = m.indexed ? m.index & 7 : rsp;
+			bytes({uint8_t(mode << 6 | (reg & 7) << 3 | rsp), uint8_t(scale << 6 | index << 3 | base)});
+		} else {
+			bytes({uint8_t(mode << 6 | (reg & 7) << 3 | base)});
+		}
+
+		if (mode == 1) {
+			imm8(m.displacement);
+		} else if (mode == 2) {
+			imm32(m.displacement);
+		}
+	}
+
+	// Opcode with a register or opcode extension and a register operand
+	void registers(std::initializer_list<uint8_t> opcode, unsigned reg, unsigned rm,
+		bool wide = false, bool byteRegisters = false)
+	{
+		prefix(wide, reg, 0, rm, byteRegisters);
+		bytes(opcode);
+		bytes({uint8_t(0xc0 | (reg & 7) << 3 | (rm & 7))});
+	}
+
+	void append(void const * data, std::size_t size)
+	{
+		auto const bytes = static_cast<uint8_t const *>(data);
+		code.insert(code.end(), bytes, bytes + size);
+	}
+};
+
+// Instructions that transfer control, change the E/M/X mode or may
+// stop the processor end a block.
+bool endsBlock(uint8_t opcode)
+{
+	switch (opcode) {
+	case 0x02: // NXT
+	case 0x10: case 0x30: case 0x50: case 0x70:
+	case 0x80: case 0x90: case 0xb0: case 0xd0: case 0xf0: // Branches
+	case 0x22: // ENT
+	case 0x4c: // JMP
+	case 0x60: // RTS
+	case 0xc2: // REP
+	case 0xcb: // WAI
+	case 0xe2: // SEP
+	case 0xef: // MMU
+	case 0xfb: // XCE
+		return true;
+	default:
+		return false;
+	}
+}
+
+int32_t memberOffset(Processor const & cpu, void const * member)
+{
+	return static_cast<char const *>(member) - reinterpret_cast<char const *>(&cpu);
+}
+
+// Where translated code finds the processor state and the runtime
+struct Layout {
+	int32_t A, B, X, Y, D, SP, PC, R, I;
+	int32_t signResult, zeroResult, carry, overflow;
+	int32_t mode, remainingCycles, instructionCount, rbTimeout, waiTimeout;
+	// PageEntry array, read pointer then write pointer
+	int32_t pages;
+
+	bool const * invalidated;
+	void const * entryPages;
+
+	uint32_t (*readMemory)(Processor *, uint32_t);
+	void (*writeMemory)(Processor *, uint32_t, uint32_t);
+	void (*multiply)(Processor *, uint32_t);
+	void (*divide)(Processor *, uint32_t);
+};
+
+struct Step {
+	void (*execute)(Processor & cpu, uint16_t operand);
+	uint16_t operand;
+	uint16_t next;
+	uint8_t opcode;
+	uint8_t cycles;
+	// Handler of an undefined opcode
+	bool unknown;
+};
+
+// Effective address kinds, named after the Processor::addr* helpers
+enum Addressing {
+	Immediate,
+	Direct,
+	BX,
+	BS,
+	BR,
+	BW,
+	BXW,
+	BWY,
+	BSWY,
+	BRWY,
+	WX,
+	WY
+};
+
+// Addressing of the ORA, AND, EOR, ADC, STA, LDA and CMP columns
+Addressing aluAddressing(uint8_t opcode)
+{
+	switch (opcode & 0x1f) {
+	case 0x01: return BXW;
+	case 0x03: return BS;
+	case 0x07: return BR;
+	case 0x09: return Immediate;
+	case 0x11: return BWY;
+	case 0x12: return BW;
+	case 0x13: return BSWY;
+	case 0x15: return BX;
+	case 0x17: return BRWY;
+	case 0x19: return WY;
+	case 0x1d: return WX;
+	default: return Direct;
+	}
+}
+
+// Emits the x86-64 code of one block. rbx holds the processor and
+// r13b is set once an instruction timed out on Redbus or overwrote
+// translated code; the block then leaves after that instruction.
+// Register values only live within an instruction.
+class Translator
+{
+public:
+	Translator(Layout const & layout, uint8_t mode) :
+		layout(layout),
+		flagE(mode & 4),
+		flagM(mode & 2),
+		flagX(mode & 1)
+	{}
+
+	// Returns the offset of the body in e.code
+	std::size_t translate(std::vector<Step> const & steps, unsigned cycles)
+	{
+		// Four pushes and the padding keep the stack 16-byte aligned
+		// for the calls.
+		e.push(rbx);
+		e.push(r13);
+		e.push(r14);
+		e.push(r15);
+		e.bytes({0x48, 0x83, 0xec, 0x08});            // sub rsp, 8
+		e.mov64(rbx, rdi);
+
+		std::size_t const body = e.size();
+		e.alu(Xor, r13, r13);
+		e.alu64(Sub, at(rbx, layout.remainingCycles), cycles);
+		e.alu64(Add, at(rbx, layout.instructionCount), int32_t(steps.size()));
+
+		chaining = cycles > 0;
+		unsigned cyclesLeft = cycles;
+		for (unsigned i = 0; i < steps.size(); ++i) {
+			Step const & step = steps[i];
+			cyclesLeft -= step.cycles;
+			unsigned const skipped = steps.size() - i - 1;
+
+			slow = false;
+			bool const last = i + 1 == steps.size();
+			if (last && finish(step)) {
+				break;
+			}
+
+			instruction(step);
+
+			if (slow) {
+				// Leave with the rest of the block refunded
+				std::size_t const jump = stopCheck();
+				uint16_t const next = step.next;
+				cold.push_back([=] {
+					e.patch(jump);
+					if (cyclesLeft != 0) {
+						e.alu64(Add, at(rbx, layout.remainingCycles), cyclesLeft);
+					}
+					if (skipped != 0) {
+						e.alu64(Sub, at(rbx, layout.instructionCount), skipped);
+					}
+					e.store16(at(rbx, layout.PC), next);
+					epilogue();
+				});
+			}
+
+			if (last) {
+				chainStatic(step.next);
+			}
+		}
+
+		// Slow paths and early exits, out of line
+		for (std::size_t i = 0; i < cold.size(); ++i) {
+			cold[i]();
+		}
+
+		return body;
+	}
+
+	Emitter e;
+private:
+	struct Address {
+		bool constant;
+		uint16_t value;
+	};
+
+	// Control transfers and block enders, returns false for other
+	// instructions
+	bool finish(Step const & step)
+	{
+		uint16_t const n = step.operand;
+
+		switch (step.opcode) {
+		case 0x02: // NXT
+			load(rsi, layout.I);
+			read(variable(), true);
+			store(layout.PC, rax);
+			e.lea(rcx, at(rsi, 2));
+			store(layout.I, rcx);
+			leaveIfStopped();
+			chainDynamic();
+			return true;
+		case 0x22: // ENT
+			load(rdi, layout.I);
+			pushReturn(true);
+			e.store16(at(rbx, layout.I), step.next);
+			e.store16(at(rbx, layout.PC), n);
+			leaveIfStopped();
+			chainStatic(n);
+			return true;
+		case 0x4c: // JMP
+			chainStatic(n);
+			return true;
+		case 0x60: // RTS
+			pull(true);
+			e.alu(Add, rax, 1);
+			store(layout.PC, rax);
+			leaveIfStopped();
+			chainDynamic();
+			return true;
+		case 0x10: branch(step, at(rbx, layout.signResult + 1), true, Equal); return true;
+		case 0x30: branch(step, at(rbx, layout.signResult + 1), true, NotEqual); return true;
+		case 0x50: branch(step, at(rbx, layout.overflow), false, Equal); return true;
+		case 0x70: branch(step, at(rbx, layout.overflow), false, NotEqual); return true;
+		case 0x80: chainStatic(step.next + int8_t(n)); return true;
+		case 0x90: branch(step, at(rbx, layout.carry), false, Equal); return true;
+		case 0xb0: branch(step, at(rbx, layout.carry), false, NotEqual); return true;
+		case 0xd0: branch(step, at(rbx, layout.zeroResult), false, NotEqual, true); return true;
+		case 0xf0: branch(step, at(rbx, layout.zeroResult), false, Equal, true); return true;
+		case 0xcb: // WAI
+			e.store8(at(rbx, layout.waiTimeout), 1);
+			e.store16(at(rbx, layout.PC), step.next);
+			epilogue();
+			return true;
+		default:
+			break;
+		}
+
+		if (step.unknown || endsBlock(step.opcode)) {
+			// REP, SEP, XCE and MMU may change the mode or the memory
+			// map, always back to the dispatch loop.
+			e.store16(at(rbx, layout.PC), step.next);
+			callHandler(step);
+			epilogue();
+			return true;
+		}
+
+		return false;
+	}
+
+	void instruction(Step const & step)
+	{
+		uint8_t const opcode = step.opcode;
+		uint16_t const n = step.operand;
+		bool const wideM = !flagM;
+		bool const wideX = !flagX;
+
+		switch (opcode) {
+		case 0x01: case 0x03: case 0x05: case 0x07: case 0x09: case 0x0d:
+		case 0x11: case 0x12: case 0x13: case 0x15: case 0x17: case 0x19: case 0x1d: // ORA
+			operand(aluAddressing(opcode), n);
+			logic(Or);
+			break;
+		case 0x21: case 0x23: case 0x25: case 0x27: case 0x29: case 0x2d:
+		case 0x31: case 0x32: case 0x33: case 0x35: case 0x37: case 0x39: case 0x3d: // AND
+			operand(aluAddressing(opcode), n);
+			logic(And);
+			break;
+		case 0x41: case 0x43: case 0x45: case 0x47: case 0x49: case 0x4d:
+		case 0x51: case 0x52: case 0x53: case 0x55: case 0x57: case 0x59: case 0x5d: // EOR
+			operand(aluAddressing(opcode), n);
+			logic(Xor);
+			break;
+		case 0x61: case 0x63: case 0x65: case 0x67: case 0x69: case 0x6d:
+		case 0x71: case 0x72: case 0x73: case 0x75: case 0x77: case 0x79: case 0x7d: // ADC
+			if (flagM) {
+				fallback(step);
+				break;
+			}
+			operand(aluAddressing(opcode), n);
+			add();
+			break;
+		case 0xe3: // SBC
+			if (flagM) {
+				fallback(step);
+				break;
+			}
+			operand(BS, n);
+			subtract();
+			break;
+		case 0xc1: case 0xc3: case 0xc5: case 0xc7: case 0xc9: case 0xcd:
+		case 0xd1: case 0xd2: case 0xd3: case 0xd5: case 0xd7: case 0xd9: case 0xdd: // CMP
+			operand(aluAddressing(opcode), n);
+			load(rcx, layout.A);
+			e.alu(Cmp, rcx, rax);
+			e.set(AboveEqual, at(rbx, layout.carry));
+			e.alu(Sub, rcx, rax);
+			updateNZ(rcx, flagM);
+			break;
+		case 0xa1: case 0xa3: case 0xa5: case 0xa9: case 0xad: case 0xb5: // LDA
+			operand(aluAddressing(opcode), n);
+			store(layout.A, rax);
+			updateNZ(rax, flagM);
+			break;
+		case 0x81: case 0x83: case 0x85: case 0x87: case 0x8d:
+		case 0x91: case 0x92: case 0x93: case 0x95: case 0x97: case 0x99: case 0x9d: { // STA
+			Address const address = effective(aluAddressing(opcode), n);
+			load(rdi, layout.A);
+			write(address, wideM);
+			break;
+		}
+		case 0x64: // STZ
+			e.alu(Xor, rdi, rdi);
+			write(Address{true, n}, wideM);
+			break;
+		case 0x04: case 0x0c: // TSB
+		case 0x14: case 0x1c: // TRB
+			read(Address{true, n}, wideM);
+			load(rcx, layout.A);
+			e.test(rcx, rax);
+			e.set(Equal, rdx);
+			e.movzx8(rdx, rdx);
+			e.store16(at(rbx, layout.zeroResult), rdx);
+			if (opcode & 0x10) {
+				e.alu(Xor, rax, 0xffff);
+				e.alu(And, rcx, rax);
+			} else {
+				e.alu(Or, rcx, rax);
+			}
+			store(layout.A, rcx);
+			break;
+		case 0x06: case 0x0e: case 0x16: case 0x1e: { // ASL
+			Address const address = effective(opcode == 0x16 ? BX : opcode == 0x1e ? WX : Direct, n);
+			read(address, wideM);
+			e.test(rax, flagM ? 0x80 : 0x8000);
+			e.set(NotEqual, at(rbx, layout.carry));
+			e.lea(rdi, at(rax, rax, 1));
+			e.alu(And, rdi, flagM ? 0xff : 0xffff);
+			updateNZ(rdi, flagM);
+			write(address, wideM);
+			break;
+		}
+		case 0xe6: case 0xee: case 0xf6: case 0xfe: { // INC
+			Address const address = effective(opcode == 0xf6 ? BX : opcode == 0xfe ? WX : Direct, n);
+			read(address, wideM);
+			e.lea(rdi, at(rax, 1));
+			e.alu(And, rdi, flagM ? 0xff : 0xffff);
+			updateNZ(rdi, flagM);
+			write(address, wideM);
+			break;
+		}
+		case 0x0f: case 0x1f: case 0x2f: case 0x3f: // MUL
+		case 0x4f: case 0x5f: case 0x6f: case 0x7f: { // DIV
+			if (flagM) {
+				fallback(step);
+				break;
+			}
+			// The interpreter's arithmetic, bit for bit
+			uint8_t const column = opcode & 0x30;
+			read(effective(column == 0x10 ? BX : column == 0x30 ? WX : Direct, n), true);
+			e.mov(rsi, rax);
+			e.mov64(rdi, rbx);
+			e.mov64(rax, reinterpret_cast<uintptr_t>(opcode < 0x40 ? layout.multiply : layout.divide));
+			e.call(rax);
+			break;
+		}
+		case 0x1a: // INC A
+		case 0x3a: // DEC A
+			load(rax, layout.A);
+			e.alu(opcode == 0x1a ? Add : Sub, rax, 1);
+			e.alu(And, rax, flagM ? 0xff : 0xffff);
+			store(layout.A, rax);
+			updateNZ(rax, flagM);
+			break;
+		case 0x2a: // ROL A
+			load(rax, layout.A);
+			e.movzx8(rcx, at(rbx, layout.carry));
+			e.lea(rax, at(rcx, rax, 2));
+			e.alu(And, rax, flagM ? 0xff : 0xffff);
+			e.test(rax, flagM ? 0x80 : 0x8000);
+			e.set(NotEqual, at(rbx, layout.carry));
+			store(layout.A, rax);
+			updateNZ(rax, flagM);
+			break;
+		case 0x6a: // ROR A
+			load(rax, layout.A);
+			e.movzx8(rcx, at(rbx, layout.carry));
+			e.shl(rcx, flagM ? 7 : 15);
+			e.mov(rdx, rax);
+			e.shr(rdx, 1);
+			e.alu(Or, rdx, rcx);
+			e.alu(And, rax, 1);
+			e.store8(at(rbx, layout.carry), rax);
+			store(layout.A, rdx);
+			updateNZ(rdx, flagM);
+			break;
+		case 0x18: // CLC
+		case 0x38: // SEC
+			e.store8(at(rbx, layout.carry), uint8_t(opcode == 0x38));
+			break;
+		case 0xaa: transfer(layout.A, layout.X, flagX, flagX); break; // TAX
+		case 0xa8: transfer(layout.A, layout.Y, flagX, flagX); break; // TAY
+		case 0xba: transfer(layout.SP, layout.X, flagX, flagX); break; // TSX
+		case 0xbb: transfer(layout.Y, layout.X, false, flagX); break; // TYX
+		case 0x8a: transfer(layout.X, layout.A, flagM, flagM); break; // TXA
+		case 0x5c: transfer(layout.X, layout.I, false, flagX); break; // TXI
+		case 0xdc: transfer(layout.I, layout.X, flagX, flagX); break; // TIX
+		case 0x9a: // TXS
+		case 0x8b: // TXR
+			load(rax, layout.X);
+			if (flagX) {
+				load(rcx, opcode == 0x9a ? layout.SP : layout.R);
+				e.alu(And, rcx, 0xff00);
+				e.movzx8(rdx, rax);
+				e.alu(Or, rcx, rdx);
+				store(layout.SP, rcx);
+			} else {
+				store(opcode == 0x9a ? layout.SP : layout.R, rax);
+			}
+			if (opcode == 0x8b) {
+				load(rax, layout.R);
+			}
+			updateNZ(rax, flagX);
+			break;
+		case 0xa0: // LDY #
+		case 0xa2: // LDX #
+			e.store16(at(rbx, opcode == 0xa0 ? layout.Y : layout.X), n);
+			e.store16(at(rbx, layout.zeroResult), n);
+			e.store16(at(rbx, layout.signResult), uint16_t(flagM ? n << 8 : n));
+			break;
+		case 0x88: // DEY
+		case 0xca: // DEX
+		case 0xe8: { // INX
+			int32_t const reg = opcode == 0x88 ? layout.Y : layout.X;
+			load(rax, reg);
+			e.alu(opcode == 0xe8 ? Add : Sub, rax, 1);
+			e.alu(And, rax, flagX ? 0xff : 0xffff);
+			store(reg, rax);
+			updateNZ(rax, flagM);
+			break;
+		}
+		case 0x8f: // ZEA
+			e.store16(at(rbx, layout.D), uint16_t(0));
+			e.store8(at(rbx, layout.B), uint8_t(0));
+			break;
+		case 0x42: // NXA
+			load(rsi, layout.I);
+			read(variable(), wideM);
+			store(layout.A, rax);
+			e.lea(rcx, at(rsi, wideM ? 2 : 1));
+			store(layout.I, rcx);
+			break;
+		case 0x48: load(rdi, layout.A); push(wideM); break; // PHA
+		case 0xdf: load(rdi, layout.D); push(wideM); break; // PHD
+		case 0x5a: load(rdi, layout.Y); push(wideX); break; // PHY
+		case 0xda: load(rdi, layout.X); push(wideX); break; // PHX
+		case 0xf4: e.mov(rdi, n); push(true); break; // PEA
+		case 0x4b: load(rdi, layout.A); pushReturn(wideM); break; // RHA
+		case 0x0b: load(rdi, layout.I); pushReturn(true); break; // RHI
+		case 0x68: pull(wideM); store(layout.A, rax); updateNZ(rax, flagM); break; // PLA
+		case 0xcf: pull(wideM); store(layout.D, rax); break; // PLD
+		case 0x7a: pull(wideX); store(layout.Y, rax); updateNZ(rax, flagX); break; // PLY
+		case 0xfa: pull(wideX); store(layout.X, rax); updateNZ(rax, flagX); break; // PLX
+		case 0x6b: pullReturn(wideM); store(layout.A, rax); updateNZ(rax, flagM); break; // RLA
+		case 0x2b: pullReturn(true); store(layout.I, rax); updateNZ(rax, flagX); break; // RLI
+		default:
+			fallback(step);
+			break;
+		}
+	}
+
+	// Interpreter handler for an instruction with no native translation
+	void fallback(Step const & step)
+	{
+		e.store16(at(rbx, layout.PC), step.next);
+		callHandler(step);
+		noteStop();
+		slow = true;
+	}
+
+	void callHandler(Step const & step)
+	{
+		e.mov64(rdi, rbx);
+		e.mov(rsi, step.operand);
+		e.mov64(rax, reinterpret_cast<uintptr_t>(step.execute));
+		e.call(rax);
+	}
+
+	// Conditional branch on a flag byte, or on the 16-bit zeroResult
+	void branch(Step const & step, Mem const & flag, bool signBit, Cond taken, bool word = false)
+	{
+		if (signBit) {
+			e.test8(flag, 0x80);
+		} else if (word) {
+			e.cmp16(flag, 0);
+		} else {
+			e.cmp8(flag, 0);
+		}
+
+		std::size_t const jump = e.jump(taken);
+		chainStatic(step.next);
+		e.patch(jump);
+		chainStatic(step.next + int8_t(step.operand));
+	}
+
+	void operand(Addressing addressing, uint16_t n)
+	{
+		if (addressing == Immediate) {
+			e.mov(rax, n);
+		} else {
+			read(effective(addressing, n), !flagM);
+		}
+	}
+
+	// Computes the address into esi unless it is constant. Indirect
+	// modes read their pointer here.
+	Address effective(Addressing addressing, uint16_t n)
+	{
+		switch (addressing) {
+		case Immediate:
+		case Direct:
+			return Address{true, n};
+		case BX:
+			offset(layout.X, n, flagX ? 0xff : 0xffff);
+			break;
+		case BS:
+			offset(layout.SP, n, 0xffff);
+			break;
+		case BR:
+			offset(layout.R, n, 0xffff);
+			break;
+		case WX:
+			offset(layout.X, n, 0xffff);
+			break;
+		case WY:
+			offset(layout.Y, n, 0xffff);
+			break;
+		case BW:
+			read(Address{true, n}, true);
+			e.mov(rsi, rax);
+			break;
+		case BXW:
+			offset(layout.X, n, 0xff);
+			read(variable(), true);
+			e.mov(rsi, rax);
+			break;
+		case BWY:
+			read(Address{true, n}, true);
+			addY();
+			break;
+		case BSWY:
+			offset(layout.SP, n, 0xffff);
+			read(variable(), true);
+			addY();
+			break;
+		case BRWY:
+			offset(layout.R, n, 0xffff);
+			read(variable(), true);
+			addY();
+			break;
+		}
+
+		return variable();
+	}
+
+	Address variable() const { return Address{false, 0}; }
+
+	void offset(int32_t reg, uint16_t n, uint16_t mask)
+	{
+		load(rsi, reg);
+		e.alu(Add, rsi, n);
+		if (mask == 0xff) {
+			e.movzx8(rsi, rsi);
+		} else {
+			e.movzx16(rsi, rsi);
+		}
+	}
+
+	void addY()
+	{
+		load(rcx, layout.Y);
+		e.alu(Add, rax, rcx);
+		e.movzx16(rsi, rax);
+	}
+
+	void logic(Alu op)
+	{
+		load(rcx, layout.A);
+		e.alu(op, rcx, rax);
+		store(layout.A, rcx);
+		updateNZ(rcx, flagM);
+	}
+
+	// ADC with a 16-bit accumulator, operand in eax
+	void add()
+	{
+		load(rcx, layout.A);
+		e.movzx8(rdx, at(rbx, layout.carry));
+		e.lea(rdi, at(rcx, rax, 1));
+		e.alu(Add, rdi, rdx);
+		e.alu(Cmp, rdi, 0xffff);
+		e.set(Above, at(rbx, layout.carry));
+		overflow();
+	}
+
+	// SBC with a 16-bit accumulator, which ignores the carry
+	void subtract()
+	{
+		load(rcx, layout.A);
+		e.mov(rdi, rcx);
+		e.alu(Sub, rdi, rax);
+		e.test(rdi, 0x10000);
+		e.set(Equal, at(rbx, layout.carry));
+		e.neg(rax);
+		overflow();
+	}
+
+	// Overflow of the result in edi from A in ecx and the operand in eax
+	void overflow()
+	{
+		e.alu(Xor, rcx, rdi);
+		e.alu(Xor, rax, rdi);
+		e.alu(And, rcx, rax);
+		e.test(rcx, 0x8000);
+		e.set(NotEqual, at(rbx, layout.overflow));
+		store(layout.A, rdi);
+		updateNZ(rdi, false);
+	}
+
+	void transfer(int32_t from, int32_t to, bool mask, bool flags8)
+	{
+		load(rax, from);
+		if (mask) {
+			e.movzx8(rax, rax);
+		}
+		store(to, rax);
+		updateNZ(rax, flags8);
+	}
+
+	// updateNZ<M> or updateNZX<X> of the value in reg
+	void updateNZ(Reg value, bool shift)
+	{
+		e.store16(at(rbx, layout.zeroResult), value);
+		if (shift) {
+			Reg const scratch = value == rdx ? rcx : rdx;
+			e.mov(scratch, value);
+			e.shl(scratch, 8);
+			e.store16(at(rbx, layout.signResult), scratch);
+		} else {
+			e.store16(at(rbx, layout.signResult), value);
+		}
+	}
+
+	void load(Reg dst, int32_t reg) { e.movzx16(dst, at(rbx, reg)); }
+	void store(int32_t reg, Reg src) { e.store16(at(rbx, reg), src); }
+
+	// Pushes edi on the stack, the high byte first
+	void push(bool wide)
+	{
+		load(rsi, layout.SP);
+		if (flagE) {
+			e.lea(rax, at(rsi, wide ? -2 : -1));
+			e.movzx8(rax, rax);
+			e.alu(And, rsi, 0xff00);
+			e.alu(Or, rsi, rax);
+		} else {
+			e.alu(Sub, rsi, wide ? 2 : 1);
+			e.movzx16(rsi, rsi);
+		}
+		store(layout.SP, rsi);
+		write(variable(), wide, flagE, true);
+	}
+
+	// Pops into eax
+	void pull(bool wide)
+	{
+		load(rsi, layout.SP);
+		read(variable(), wide, flagE);
+		e.lea(rcx, at(rsi, wide ? 2 : 1));
+		if (flagE) {
+			e.movzx8(rcx, rcx);
+			e.mov(rdx, rsi);
+			e.alu(And, rdx, 0xff00);
+			e.alu(Or, rcx, rdx);
+		}
+		store(layout.SP, rcx);
+	}
+
+	void pushReturn(bool wide)
+	{
+		load(rsi, layout.R);
+		e.alu(Sub, rsi, wide ? 2 : 1);
+		e.movzx16(rsi, rsi);
+		store(layout.R, rsi);
+		write(variable(), wide, false, true);
+	}
+
+	void pullReturn(bool wide)
+	{
+		load(rsi, layout.R);
+		read(variable(), wide);
+		e.lea(rcx, at(rsi, wide ? 2 : 1));
+		store(layout.R, rcx);
+	}
+
+	// Loads into eax from a constant address or the one in esi, which
+	// is preserved. A 16-bit access crossing a page, or a page without
+	// a host pointer, takes the slow path. wrapPage keeps the high byte
+	// within the page of the low one, as E mode stack accesses do.
+	void read(Address address, bool wide, bool wrapPage = false)
+	{
+		std::vector<std::size_t> jumps;
+
+		if (address.constant) {
+			uint8_t const low = address.value & 0xff;
+			if (wide && low == 0xff) {
+				jumps.push_back(e.jump());
+			} else {
+				e.load64(rdx, at(rbx, layout.pages + (address.value >> 8) * 16));
+				e.test64(rdx, rdx);
+				jumps.push_back(e.jump(Equal));
+				if (wide) {
+					e.movzx16(rax, at(rdx, low));
+				} else {
+					e.movzx8(rax, at(rdx, low));
+				}
+			}
+		} else {
+			pageEntry(0);
+			jumps.push_back(e.jump(Equal));
+			if (wide) {
+				e.cmp8(rsi, 0xff);
+				jumps.push_back(e.jump(Equal));
+			}
+			e.movzx8(rcx, rsi);
+			if (wide) {
+				e.movzx16(rax, at(rdx, rcx, 1));
+			} else {
+				e.movzx8(rax, at(rdx, rcx, 1));
+			}
+		}
+
+		std::size_t const resume = e.size();
+		slow = true;
+		cold.push_back([=] {
+			for (std::size_t jump : jumps) {
+				e.patch(jump);
+			}
+			if (address.constant) {
+				e.mov(rsi, address.value);
+			}
+
+			e.mov(r15, rsi);
+			callRuntime(reinterpret_cast<uintptr_t>(layout.readMemory));
+			if (wide) {
+				e.mov(r14, rax);
+				highAddress(wrapPage);
+				callRuntime(reinterpret_cast<uintptr_t>(layout.readMemory));
+				e.shl(rax, 8);
+				e.alu(Or, rax, r14);
+			}
+			noteStop();
+			e.mov(rsi, r15);
+			e.patch(e.jump(), resume);
+		});
+	}
+
+	// Stores edi to a constant address or the one in esi, preserving
+	// both. highFirst writes the high byte first, as pushes do.
+	void write(Address address, bool wide, bool wrapPage = false, bool highFirst = false)
+	{
+		std::vector<std::size_t> jumps;
+
+		if (address.constant) {
+			uint8_t const low = address.value & 0xff;
+			if (wide && low == 0xff) {
+				jumps.push_back(e.jump());
+			} else {
+				e.load64(rdx, at(rbx, layout.pages + (address.value >> 8) * 16 + 8));
+				e.test64(rdx, rdx);
+				jumps.push_back(e.jump(Equal));
+				if (wide) {
+					e.store16(at(rdx, low), rdi);
+				} else {
+					e.store8(at(rdx, low), rdi);
+				}
+			}
+		} else {
+			pageEntry(8);
+			jumps.push_back(e.jump(Equal));
+			if (wide) {
+				e.cmp8(rsi, 0xff);
+				jumps.push_back(e.jump(Equal));
+			}
+			e.movzx8(rcx, rsi);
+			if (wide) {
+				e.store16(at(rdx, rcx, 1), rdi);
+			} else {
+				e.store8(at(rdx, rcx, 1), rdi);
+			}
+		}
+
+		std::size_t const resume = e.size();
+		slow = true;
+		cold.push_back([=] {
+			for (std::size_t jump : jumps) {
+				e.patch(jump);
+			}
+			if (address.constant) {
+				e.mov(rsi, address.value);
+			}
+
+			e.mov(r15, rsi);
+			e.mov(r14, rdi);
+			if (!wide) {
+				writeByte(false, wrapPage);
+			} else if (highFirst) {
+				writeByte(true, wrapPage);
+				writeByte(false, wrapPage);
+			} else {
+				writeByte(false, wrapPage);
+				writeByte(true, wrapPage);
+			}
+			noteStop();
+			e.mov(rsi, r15);
+			e.mov(rdi, r14);
+			e.patch(e.jump(), resume);
+		});
+	}
+
+	// Host pointer of the page of esi into rdx, setting ZF when null
+	void pageEntry(int32_t field)
+	{
+		e.mov(rax, rsi);
+		e.shr(rax, 8);
+		e.shl(rax, 4);
+		e.load64(rdx, at(rbx, rax, 1, layout.pages + field));
+		e.test64(rdx, rdx);
+	}
+
+	// Slow path byte write of r14d, or its high byte, to r15d
+	void writeByte(bool high, bool wrapPage)
+	{
+		if (high) {
+			highAddress(wrapPage);
+		} else {
+			e.mov(rsi, r15);
+		}
+		e.mov(rdx, r14);
+		if (high) {
+			e.shr(rdx, 8);
+		}
+		callRuntime(reinterpret_cast<uintptr_t>(layout.writeMemory));
+	}
+
+	// Address of the high byte of a 16-bit access at r15d into esi
+	void highAddress(bool wrapPage)
+	{
+		e.lea(rsi, at(r15, 1));
+		if (wrapPage) {
+			e.movzx8(rsi, rsi);
+			e.mov(rcx, r15);
+			e.alu(And, rcx, 0xff00);
+			e.alu(Or, rsi, rcx);
+		} else {
+			e.movzx16(rsi, rsi);
+		}
+	}
+
+	void callRuntime(uint64_t function)
+	{
+		e.mov64(rdi, rbx);
+		e.mov64(rax, function);
+		e.call(rax);
+	}
+
+	// Folds the stop conditions into r13b, preserving eax
+	void noteStop()
+	{
+		e.mov64(rcx, reinterpret_cast<uintptr_t>(layout.invalidated));
+		e.movzx8(rdx, at(rcx));
+		e.or8(rdx, at(rbx, layout.rbTimeout));
+		e.or8(r13, rdx);
+	}
+
+	std::size_t stopCheck()
+	{
+		e.test(r13, r13);
+		return e.jump(NotEqual);
+	}
+
+	// After a control transfer that stored PC
+	void leaveIfStopped()
+	{
+		if (!slow) {
+			return;
+		}
+
+		std::size_t const jump = stopCheck();
+		cold.push_back([=] {
+			e.patch(jump);
+			epilogue();
+		});
+		slow = false;
+	}
+
+	void chainStatic(uint16_t target)
+	{
+		e.store16(at(rbx, layout.PC), target);
+		if (!chaining) {
+			epilogue();
+			return;
+		}
+
+		std::vector<std::size_t> misses;
+		e.mov64(rdx, reinterpret_cast<uintptr_t>(layout.entryPages));
+		e.load64(rdx, at(rdx, (target >> 8) * 8));
+		e.test64(rdx, rdx);
+		misses.push_back(e.jump(Equal));
+		e.load64(rdx, at(rdx, (target & 0xff) * 16));
+		enter(misses);
+	}
+
+	// To the address in PC
+	void chainDynamic()
+	{
+		if (!chaining) {
+			epilogue();
+			return;
+		}
+
+		std::vector<std::size_t> misses;
+		load(rax, layout.PC);
+		e.mov(rcx, rax);
+		e.shr(rcx, 8);
+		e.mov64(rdx, reinterpret_cast<uintptr_t>(layout.entryPages));
+		e.load64(rdx, at(rdx, rcx, 8));
+		e.test64(rdx, rdx);
+		misses.push_back(e.jump(Equal));
+		e.movzx8(rax, rax);
+		e.shl(rax, 4);
+		e.load64(rdx, at(rdx, rax, 1));
+		enter(misses);
+	}
+
+	// Jumps to the block in rdx when it suits the current mode and the
+	// remaining cycles, otherwise returns to the dispatch loop, which
+	// also counts the entry towards translation.
+	void enter(std::vector<std::size_t> & misses)
+	{
+		e.test64(rdx, rdx);
+		misses.push_back(e.jump(Equal));
+		e.movzx8(rcx, at(rbx, layout.mode));
+		e.cmp8(at(rdx, offsetof(BlockCompiler::Block, mode)), rcx);
+		misses.push_back(e.jump(NotEqual));
+		e.load64(rcx, at(rbx, layout.remainingCycles));
+		e.cmp64(rcx, at(rdx, offsetof(BlockCompiler::Block, requiredCycles)));
+		misses.push_back(e.jump(Less));
+		e.jmp(at(rdx, offsetof(BlockCompiler::Block, body)));
+
+		for (std::size_t miss : misses) {
+			e.patch(miss);
+		}
+		epilogue();
+	}
+
+	void epilogue()
+	{
+		e.bytes({0x48, 0x83, 0xc4, 0x08});            // add rsp, 8
+		e.pop(r15);
+		e.pop(r14);
+		e.pop(r13);
+		e.pop(rbx);
+		e.ret();
+	}
+
+	Layout const & layout;
+	bool const flagE;
+	bool const flagM;
+	bool const flagX;
+
+	// Whether blocks may jump into each other, not for blocks that
+	// take no cycles and could loop forever
+	bool chaining = true;
+	// Whether the current instruction may have set the stop flag
+	bool slow = false;
+	std::vector<std::function<void()>> cold;
+};
+
+}
+
+BlockCompiler::BlockCompiler(Processor & processor) :
+	processor(processor),
+	entryPages(),
+	entryStorage(),
+	pageBlocks(),
+	blocks(),
+	codeBuffer(nullptr),
+	codeUsed(0),
+	invalidated(false)
+{}
+
+BlockCompiler::~BlockCompiler()
+{
+#ifdef EFORTHPC_JIT_X86_64
+	if (codeBuffer != nullptr) {
+		munmap(codeBuffer, codeBufferSize);
+	}
+#endif
+}
+
+bool BlockCompiler::isSupported()
+{
+#ifdef EFORTHPC_JIT_X86_64
+	return true;
+#else
+	return false;
+#endif
+}
+
+BlockCompiler::Block const * BlockCompiler::lookup(uint16_t address)
+{
+	Entry & cached = entry(address);
+	if (cached.block != nullptr && cached.block->mode == processor.mode) {
+		return cached.block;
+	}
+
+	if (++cached.hits < hotThreshold) {
+		return nullptr;
+	}
+
+	cached.hits = 0;
+	if (cached.block != nullptr) {
+		// Translated for another mode
+		cached.block->valid = false;
+		cached.block = nullptr;
+	}
+
+	// Translation may flush and reallocate the entries
+	Block * block = compile(address);
+	entry(address).block = block;
+
+	return block;
+}
+
+void BlockCompiler::execute(Block const & block)
+{
+	invalidated = false;
+	block.code(&processor);
+}
+
+void BlockCompiler::invalidate(uint16_t address)
+{
+	auto & list = pageBlocks[address >> 8];
+
+	for (Block * block : list) {
+		if (!block->valid || uint16_t(address - block->start) >= block->size) {
+			continue;
+		}
+
+		block->valid = false;
+		invalidated = true;
+
+		Entry & cached = entry(block->start);
+		if (cached.block == block) {
+			cached.block = nullptr;
+		}
+	}
+
+	list.erase(std::remove_if(list.begin(), list.end(),
+		[](Block const * block) { return !block->valid; }), list.end());
+}
+
+void BlockCompiler::flush()
+{
+	entryPages.fill(nullptr);
+	entryStorage.clear();
+	for (auto & list : pageBlocks) {
+		list.clear();
+	}
+	blocks.clear();
+
+	// Code of a block still on the stack stays intact, it is only
+	// overwritten by later translations.
+	codeUsed = 0;
+	invalidated = true;
+}
+
+BlockCompiler::Block * BlockCompiler::compile(uint16_t address)
+{
+	static_assert(sizeof(Entry) == 16, "Translated code indexes entries by shifting");
+	static_assert(sizeof(Processor::PageEntry) == 16, "Translated code indexes pages by shifting");
+	static_assert(sizeof(long) == 8 && sizeof(uint8_t *) == 8, "Translated code assumes LP64");
+
+	Processor & cpu = processor;
+
+	std::vector<Step> steps;
+	uint16_t pc = address;
+	uint16_t size = 0;
+	unsigned cycles = 0;
+
+	while (steps.size() < maxBlockLength) {
+		// Fetching through the Redbus window has side effects, leave
+		// it to the interpreter.
+		if (cpu.isRedbusAddress(pc)) {
+			break;
+		}
+
+		uint8_t const opcode = cpu.readOnlyMemory(pc);
+		uint8_t const length = (*cpu.instructions)[opcode].length;
+
+		bool fetchesRedbus = false;
+		for (uint16_t i = 1; i < length; ++i) {
+			fetchesRedbus |= cpu.isRedbusAddress(pc + i);
+		}
+		if (fetchesRedbus) {
+			break;
+		}
+
+		Processor::DecodedInstruction const decoded = cpu.decodeInstruction(pc);
+		bool const unknown = decoded.execute == &Processor::unknownOpcode;
+		pc += decoded.length;
+		size += decoded.length;
+		cycles += decoded.cycles;
+		steps.push_back(Step{decoded.execute, decoded.operand, pc, opcode, decoded.cycles, unknown});
+
+		if (endsBlock(opcode) || unknown) {
+			break;
+		}
+	}
+
+	if (steps.empty()) {
+		return nullptr;
+	}
+
+	Layout const layout = {
+		memberOffset(cpu, &cpu.regs.A),
+		memberOffset(cpu, &cpu.regs.B),
+		memberOffset(cpu, &cpu.regs.X),
+		memberOffset(cpu, &cpu.regs.Y),
+		memberOffset(cpu, &cpu.regs.D),
+		memberOffset(cpu, &cpu.regs.SP),
+		memberOffset(cpu, &cpu.regs.PC),
+		memberOffset(cpu, &cpu.regs.R),
+		memberOffset(cpu, &cpu.regs.I),
+		memberOffset(cpu, &cpu.signResult),
+		memberOffset(cpu, &cpu.zeroResult),
+		memberOffset(cpu, &cpu.carry),
+		memberOffset(cpu, &cpu.overflow),
+		memberOffset(cpu, &cpu.mode),
+		memberOffset(cpu, &cpu.remainingCycles),
+		memberOffset(cpu, &cpu.instructionCount),
+		memberOffset(cpu, &cpu.rbTimeout),
+		memberOffset(cpu, &cpu.waiTimeout),
+		memberOffset(cpu, cpu.pages.data()),
+		&invalidated,
+		entryPages.data(),
+		&BlockCompiler::readMemory,
+		&BlockCompiler::writeMemory,
+		&BlockCompiler::multiply,
+		&BlockCompiler::divide
+	};
+
+	Translator translator(layout, cpu.mode);
+	std::size_t const body = translator.translate(steps, cycles);
+
+	uint8_t * start = nullptr;
+	if (!allocateCode(translator.e.code, start)) {
+		flush();
+		if (!allocateCode(translator.e.code, start)) {
+			return nullptr;
+		}
+	}
+
+	long const requiredCycles = long(cycles) - steps.back().cycles + 1;
+	blocks.push_back(Block{reinterpret_cast<BlockFunction>(start), start + body,
+		address, size, cpu.mode, uint8_t(steps.size()), cycles, requiredCycles, true});
+	Block * block = &blocks.back();
+
+	pageBlocks[address >> 8].push_back(block);
+	uint8_t const lastPage = uint16_t(address + size - 1) >> 8;
+	if (lastPage != address >> 8) {
+		pageBlocks[lastPage].push_back(block);
+	}
+
+	return block;
+}
+
+bool BlockCompiler::allocateCode(std::vector<uint8_t> const & code, uint8_t * & start)
+{
+#ifdef EFORTHPC_JIT_X86_64
+	if (codeBuffer == nullptr) {
+		void * buffer = mmap(nullptr, codeBufferSize,
+			PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buffer == MAP_FAILED) {
+			return false;
+		}
+		codeBuffer = static_cast<uint8_t *>(buffer);
+	}
+
+	unsigned const offset = (codeUsed + 15) & ~15u;
+	if (offset + code.size() > codeBufferSize) {
+		return false;
+	}
+
+	std::copy(code.begin(), code.end(), codeBuffer + offset);
+	codeUsed = offset + code.size();
+	start = codeBuffer + offset;
+
+	return true;
+#else
+	(void)code;
+	(void)start;
+	return false;
+#endif
+}
+
+BlockCompiler::Entry & BlockCompiler::entry(uint16_t address)
+{
+	EntryPage * & page = entryPages[address >> 8];
+	if (page == nullptr) {
+		entryStorage.emplace_back();
+		page = &entryStorage.back();
+		page->fill(Entry{nullptr, 0});
+	}
+
+	return (*page)[address & 0xff];
+}
+
+uint32_t BlockCompiler::readMemory(Processor * cpu, uint32_t address)
+{
+	return cpu->readMemory(address);
+}
+
+void BlockCompiler::writeMemory(Processor * cpu, uint32_t address, uint32_t value)
+{
+	cpu->writeMemory(address, value);
+}
+
+void BlockCompiler::multiply(Processor * cpu, uint32_t value)
+{
+	cpu->i_mul<false>(value);
+}
+
+void BlockCompiler::divide(Processor * cpu, uint32_t value)
+{
+	cpu->i_div<false>(value);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Processor;
+
+// Translates hot 65EL02 basic blocks into x86-64 code. Loads, stores,
+// ALU, stack and threading instructions are emitted natively with the
+// page table lookup inline. Accesses the page table sends down the slow
+// path, such as the Redbus window, call the interpreter's memory
+// helpers, and the rare instructions without a native translation, such
+// as those changing the mode, call their handlers. A block ending in a
+// jump, branch, NXT, ENT or RTS jumps straight into the block at the
+// target when that is translated for the current mode and enough cycles
+// remain, so threaded code runs without returning to the dispatch loop.
+class BlockCompiler
+{
+public:
+	typedef void (*BlockFunction)(Processor * cpu);
+
+	struct Block {
+		BlockFunction code;
+		// Entry point for blocks jumping here, past the prologue
+		uint8_t const * body;
+		uint16_t start;
+		uint16_t size;
+		uint8_t mode;
+		uint8_t length;
+		// Cycles of the whole block, and the cycles needed before
+		// entering it for the interpreter to have run all of it.
+		unsigned cycles;
+		long requiredCycles;
+		bool valid;
+	};
+
+	explicit BlockCompiler(Processor & processor);
+	~BlockCompiler();
+
+	BlockCompiler(BlockCompiler const &) = delete;
+	BlockCompiler & operator=(BlockCompiler const &) = delete;
+
+	static bool isSupported();
+
+	// Returns the block starting at address for the current mode,
+	// counting the entry and translating the block once it gets hot.
+	Block const * lookup(uint16_t address);
+
+	// Runs a block and the blocks it chains into. Cycles and
+	// instructions are accounted in the processor, which is left at
+	// the first instruction not run.
+	void execute(Block const & block);
+
+	void invalidate(uint16_t address);
+	void flush();
+private:
+	struct Entry {
+		Block * block;
+		uint16_t hits;
+	};
+
+	typedef std::array<Entry, 256> EntryPage;
+
+	Block * compile(uint16_t address);
+	bool allocateCode(std::vector<uint8_t> const & code, uint8_t * & start);
+	Entry & entry(uint16_t address);
+
+	// Slow paths of translated code
+	static uint32_t readMemory(Processor * cpu, uint32_t address);
+	static void writeMemory(Processor * cpu, uint32_t address, uint32_t value);
+	static void multiply(Processor * cpu, uint32_t value);
+	static void divide(Processor * cpu, uint32_t value);
+
+	static unsigned const hotThreshold = 32;
+	static unsigned const maxBlockLength = 64;
+	static unsigned const codeBufferSize = 4 * 1024 * 1024;
+
+	Processor & processor;
+
+	// Entries by page, null until the page is first looked up. Read
+	// by translated code to chain blocks, so kept as plain pointers
+	// into entryStorage.
+	std::array<EntryPage *, 256> entryPages;
+	std::deque<EntryPage> entryStorage;
+	std::array<std::vector<Block *>, 256> pageBlocks;
+	std::deque<Block> blocks;
+
+	uint8_t * codeBuffer;
+	unsigned codeUsed;
+
+	// Set when a write hits translated code, checked by running blocks
+	bool invalidated;
+};
@@ -1,7 +1,11 @@
 #include "Console.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
+#include "common/StateStream.h"
+
 Console::Console(RedbusNetwork & network, uint8_t address) :
 	RedbusDevice(network, address),
 	screen(),
@@ -18,50 +22,170 @@ Console::Console(RedbusNetwork & network, uint8_t address) :
 	blitXD(),
 	blitYD(),
 	blitW(),
-	blitH()
+	blitH(),
+	snapshots(),
+	keyQueue(),
+	texture(),
+	textureLoaded(false),
+	textureMissing(false),
+	vertices(),
+	drawnScreen()
 {
 	screen.fill(32);
+	publishSnapshot(0);
 }
 
-void Console::draw(sf::RenderWindow & window, unsigned long ticks)
+Console::Console(RedbusNetwork & network, Console const & other) :
+	RedbusDevice(network, other.getAddress()),
+	screen(other.screen),
+	kbBuffer(other.kbBuffer),
+	memoryRow(other.memoryRow),
+	cursorX(other.cursorX),
+	cursorY(other.cursorY),
+	cursorMode(other.cursorMode),
+	kbStart(other.kbStart),
+	kbPosition(other.kbPosition),
+	blitMode(other.blitMode),
+	blitXS(other.blitXS),
+	blitYS(other.blitYS),
+	blitXD(other.blitXD),
+	blitYD(other.blitYD),
+	blitW(other.blitW),
+	blitH(other.blitH),
+	snapshots(),
+	keyQueue(),
+	texture(),
+	textureLoaded(false),
+	textureMissing(false),
+	vertices(),
+	drawnScreen()
 {
-	sf::Texture drawTexture;
-	if (!drawTexture.loadFromFile("resources/gui/displaygui.png")) {
-		return;
-	}
+	publishSnapshot(0);
+}
 
-	sf::Sprite drawSprite;
-	drawSprite.setTexture(drawTexture);
-	drawSprite.setTextureRect(sf::IntRect(0, 0, 350, 230));
-	drawSprite.setPosition(sf::Vector2f(0, 0));
+void Console::draw(sf::RenderWindow & window)
+{
+	Snapshot const & snapshot = readSnapshot();
 
-	window.draw(drawSprite);
+	if (!textureLoaded) {
+		if (textureMissing || !texture.loadFromFile("resources/gui/displaygui.png")) {
+			textureMissing = true;
+			return;
+		}
 
-	drawSprite.setColor(sf::Color(0, 255, 0));
+		textureLoaded = true;
+		buildVertices();
+	}
 
-	for (unsigned y = 0; y < 50; ++y) {
-		for (unsigned x = 0; x < 80; ++x) {
-			uint8_t symbol = screen[y * screenWidth + x];
+	for (unsigned y = 0; y < screenHeight; ++y) {
+		for (unsigned x = 0; x < screenWidth; ++x) {
+			unsigned const cell = y * screenWidth + x;
+			uint8_t symbol = snapshot.screen[cell];
 
-			if (x == cursorX && y == cursorY) {
-				if (cursorMode == 1) {
+			if (x == snapshot.cursorX && y == snapshot.cursorY) {
+				if (snapshot.cursorMode == 1) {
 					symbol ^= 128;
-				} else if (cursorMode == 2) {
-					if (ticks >> 2 & 0x1) {
+				} else if (snapshot.cursorMode == 2) {
+					if (snapshot.ticks / cursorBlinkTicks & 0x1) {
 						symbol ^= 128;
 					}
 				}
 			}
 
-			if (symbol != 32) {
-				drawSprite.setTextureRect(sf::IntRect(350 + (symbol & 15) * 8, (symbol >> 4) * 8, 8, 8));
-				drawSprite.setPosition(sf::Vector2f(x*4+15, y*4+15));
-				drawSprite.setScale(sf::Vector2f(0.5f, 0.5f));
-
-				window.draw(drawSprite);
+			if (symbol != drawnScreen[cell]) {
+				drawCell(cell, symbol);
 			}
 		}
 	}
+
+	window.draw(vertices, &texture);
+}
+
+void Console::buildVertices()
+{
+	vertices.setPrimitiveType(sf::Quads);
+	vertices.resize(4 * (1 + screenWidth * screenHeight));
+
+	// The frame, 350x230 at the top left of the texture and untinted
+	sf::Vector2f const corners[4] = {{0, 0}, {350, 0}, {350, 230}, {0, 230}};
+	for (unsigned i = 0; i < 4; ++i) {
+		vertices[i].position = corners[i];
+		vertices[i].texCoords = corners[i];
+	}
+
+	// Cells start out as spaces, which are not drawn
+	for (unsigned i = 4; i < vertices.getVertexCount(); ++i) {
+		vertices[i].position = sf::Vector2f(0, 0);
+		vertices[i].color = sf::Color(0, 255, 0);
+	}
+	drawnScreen.fill(32);
+}
+
+void Console::drawCell(unsigned cell, uint8_t symbol)
+{
+	sf::Vertex * quad = &vertices[4 * (1 + cell)];
+	drawnScreen[cell] = symbol;
+
+	if (symbol == 32) {
+		for (unsigned i = 0; i < 4; ++i) {
+			quad[i].position = sf::Vector2f(0, 0);
+		}
+		return;
+	}
+
+	// Glyphs are 8x8 to the right of the frame in the texture, 16 per
+	// row, and drawn at half size from 15, 15
+	float const x = cell % screenWidth * 4 + 15;
+	float const y = cell / screenWidth * 4 + 15;
+	float const u = 350 + (symbol & 15) * 8;
+	float const v = (symbol >> 4) * 8;
+
+	quad[0].position = sf::Vector2f(x, y);
+	quad[1].position = sf::Vector2f(x + 4, y);
+	quad[2].position = sf::Vector2f(x + 4, y + 4);
+	quad[3].position = sf::Vector2f(x, y + 4);
+
+	quad[0].texCoords = sf::Vector2f(u, v);
+	quad[1].texCoords = sf::Vector2f(u + 8, v);
+	quad[2].texCoords = sf::Vector2f(u + 8, v + 8);
+	quad[3].texCoords = sf::Vector2f(u, v + 8);
+}
+
+Console::Snapshot const & Console::readSnapshot()
+{
+	return snapshots.read();
+}
+
+bool Console::hasNewSnapshot() const
+{
+	return snapshots.isFresh();
+}
+
+void Console::postKey(uint8_t key)
+{
+	// Dropped like keys typed into a full keyboard buffer
+	keyQueue.push(key);
+}
+
+void Console::publishSnapshot(unsigned long ticks)
+{
+	Snapshot & snapshot = snapshots.writeBuffer();
+	snapshot.screen = screen;
+	snapshot.cursorX = cursorX;
+	snapshot.cursorY = cursorY;
+	snapshot.cursorMode = cursorMode;
+	snapshot.ticks = ticks;
+	snapshots.publish();
+}
+
+bool Console::receiveKey(uint8_t & key)
+{
+	if (isKeyBufferFull() || !keyQueue.pop(key)) {
+		return false;
+	}
+
+	pushKey(key);
+	return true;
 }
 
 void Console::pushKey(uint8_t key)
@@ -73,6 +197,21 @@ void Console::pushKey(uint8_t key)
 	}
 }
 
+bool Console::hasPendingKeys() const
+{
+	return kbStart != kbPosition;
+}
+
+bool Console::isKeyBufferFull() const
+{
+	return ((kbPosition + 1) & 15) == kbStart;
+}
+
+bool Console::isCursorBlinking() const
+{
+	return cursorMode == 2;
+}
+
 uint8_t Console::read(uint8_t address)
 {
 	if (address >= 16
@@ -109,14 +248,14 @@ void Console::write(uint8_t address, uint8_t value)
 	}
 
 	switch (address) {
-	case 0: memoryRow = value; if (memoryRow > 49) memoryRow = 49; return;
+	case 0: memoryRow = value; if (memoryRow > 49) memoryRow = 49; remapMemory(); return;
 	case 1: cursorX = value; return;
 	case 2: cursorY = value; return;
 	case 3: cursorMode = value; return;
 	case 4: kbStart = value & 0xf; return;
 	case 5: kbPosition = value & 0xf; return;
 	case 6: kbBuffer[kbStart] = value; return;
-	case 7: blitMode = value; return;
+	case 7: blitMode = value; blit(); return;
 	case 8: blitXS = value; return;
 	case 9: blitYS = value; return;
 	case 10: blitXD = value; return;
@@ -127,6 +266,118 @@ void Console::write(uint8_t address, uint8_t value)
 	}
 }
 
+void Console::blit()
+{
+	// Clipped to the screen like RedPower displays do, fill takes its
+	// value from the source X register
+	int const width = std::min<int>(blitW, int(screenWidth) - blitXD);
+	int const height = std::min<int>(blitH, int(screenHeight) - blitYD);
+	if (width <= 0 || height <= 0) {
+		blitMode = 0;
+		return;
+	}
+
+	uint8_t * const destination = &screen[blitYD * screenWidth + blitXD];
+
+	switch (blitMode) {
+	case BlitFill:
+		for (int row = 0; row < height; ++row) {
+			std::fill_n(destination + row * screenWidth, width, blitXS);
+		}
+		break;
+	case BlitInvert:
+		for (int row = 0; row < height; ++row) {
+			uint8_t * const cells = destination + row * screenWidth;
+			for (int column = 0; column < width; ++column) {
+				cells[column] ^= 0x80;
+			}
+		}
+		break;
+	case BlitCopy: {
+		int const copyWidth = std::min<int>(width, int(screenWidth) - blitXS);
+		int const copyHeight = std::min<int>(height, int(screenHeight) - blitYS);
+		if (copyWidth <= 0 || copyHeight <= 0) {
+			break;
+		}
+
+		// Rows are copied in the order that reads every source row
+		// before overwriting it, memmove takes care of overlap within
+		// a row
+		uint8_t const * const source = &screen[blitYS * screenWidth + blitXS];
+		if (source > destination) {
+			for (int row = 0; row < copyHeight; ++row) {
+				std::memmove(destination + row * screenWidth, source + row * screenWidth, copyWidth);
+			}
+		} else {
+			for (int row = copyHeight - 1; row >= 0; --row) {
+				std::memmove(destination + row * screenWidth, source + row * screenWidth, copyWidth);
+			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	blitMode = 0;
+}
+
+void Console::mapMemory(MemoryMap & map)
+{
+	for (unsigned i = 0; i < screenWidth; ++i) {
+		map[16 + i] = &screen[memoryRow * screenWidth + i];
+	}
+}
+
+void Console::saveState(StateWriter & out) const
+{
+	out.u8(getAddress());
+	out.bytes(screen.data(), screen.size());
+	out.bytes(kbBuffer.data(), kbBuffer.size());
+
+	out.u8(memoryRow);
+	out.u8(cursorX);
+	out.u8(cursorY);
+	out.u8(cursorMode);
+	out.u8(kbStart);
+	out.u8(kbPosition);
+	out.u8(blitMode);
+	out.u8(blitXS);
+	out.u8(blitYS);
+	out.u8(blitXD);
+	out.u8(blitYD);
+	out.u8(blitW);
+	out.u8(blitH);
+}
+
+void Console::loadState(StateReader & in)
+{
+	setAddress(in.u8());
+	in.bytes(screen.data(), screen.size());
+	in.bytes(kbBuffer.data(), kbBuffer.size());
+
+	memoryRow = in.u8();
+	cursorX = in.u8();
+	cursorY = in.u8();
+	cursorMode = in.u8();
+	kbStart = in.u8() & 0xf;
+	kbPosition = in.u8() & 0xf;
+	blitMode = in.u8();
+	blitXS = in.u8();
+	blitYS = in.u8();
+	blitXD = in.u8();
+	blitYD = in.u8();
+	blitW = in.u8();
+	blitH = in.u8();
+
+	if (memoryRow > 49) {
+		memoryRow = 49;
+	}
+	remapMemory();
+
+	publishSnapshot(0);
+}
+
 void Console::debugPrint() const
 {
 	for (unsigned y = 0; y < screenHeight; ++y) {
@@ -134,6 +385,7 @@ void Console::debugPrint() const
 			uint8_t symbol = screen[y * screenWidth + x];
 			std::cout << static_cast<char>(symbol);
 		}
-		std::cout << std::endl;
+		std::cout << '\n';
 	}
+	std::cout << std::flush;
 }
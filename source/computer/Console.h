@@ -5,25 +5,82 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "common/SpscQueue.h"
+#include "common/TripleBuffer.h"
 #include "RedbusDevice.h"
 #include "RedbusNetwork.h"
 
+class StateReader;
+class StateWriter;
+
 class Console : public RedbusDevice
 {
 public:
+	static unsigned const screenWidth = 80;
+	static unsigned const screenHeight = 50;
+	// A blinking cursor toggles every cursorBlinkTicks ticks
+	static unsigned const cursorBlinkTicks = 4;
+
+	// What the renderer needs of the console, published once per batch
+	// of ticks by the emulation thread.
+	struct Snapshot {
+		std::array<uint8_t, screenWidth*screenHeight> screen;
+		uint8_t cursorX;
+		uint8_t cursorY;
+		uint8_t cursorMode;
+		unsigned long ticks;
+	};
+
 	Console(RedbusNetwork & network, uint8_t address);
+	// Copies the state of other onto network
+	Console(RedbusNetwork & network, Console const & other);
+
+	// Render thread: draws the latest published snapshot and queues
+	// keys for the emulation thread.
+	void draw(sf::RenderWindow & window);
+	// For renderers of their own
+	Snapshot const & readSnapshot();
+	// True when a snapshot was published since the last draw
+	bool hasNewSnapshot() const;
+	void postKey(uint8_t key);
+
+	// Emulation thread
+	void publishSnapshot(unsigned long ticks);
+	// Moves the next posted key into the keyboard buffer, returns false
+	// when there is none or the buffer is full
+	bool receiveKey(uint8_t & key);
 
-	void draw(sf::RenderWindow & window, unsigned long ticks);
 	void pushKey(uint8_t key);
+	bool hasPendingKeys() const;
+	bool isKeyBufferFull() const;
+	bool isCursorBlinking() const;
 
 	uint8_t read(uint8_t address) override;
 	void write(uint8_t address, uint8_t value) override;
+	// The screen row selected by the memory row register
+	void mapMemory(MemoryMap & map) override;
+
+	void saveState(StateWriter & out) const;
+	void loadState(StateReader & in);
 
 	void debugPrint() const;
 private:
-	static unsigned const screenWidth = 80;
-	static unsigned const screenHeight = 50;
 	static unsigned const kbBufferSize = 16;
+	static unsigned const keyQueueSize = 64;
+
+	enum BlitMode {
+		BlitFill	= 1,
+		BlitInvert	= 2,
+		BlitCopy	= 3
+	};
+
+	// Runs the blit set up in the blit registers at once, a row at a
+	// time, and clears blitMode
+	void blit();
+
+	// Render thread
+	void buildVertices();
+	void drawCell(unsigned cell, uint8_t symbol);
 
 	std::array<uint8_t, screenWidth*screenHeight> screen;
 	std::array<uint8_t, kbBufferSize> kbBuffer;
@@ -41,4 +98,16 @@ private:
 	uint8_t blitYD;
 	uint8_t blitW;
 	uint8_t blitH;
+
+	TripleBuffer<Snapshot> snapshots;
+	SpscQueue<uint8_t, keyQueueSize> keyQueue;
+
+	// Render thread: the frame and the glyphs, loaded by the first draw,
+	// and a quad for the frame followed by one per cell, drawn at once.
+	// Cells only get new vertices when the symbol they show changes.
+	sf::Texture texture;
+	bool textureLoaded;
+	bool textureMissing;
+	sf::VertexArray vertices;
+	std::array<uint8_t, screenWidth*screenHeight> drawnScreen;
 };
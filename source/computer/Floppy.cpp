@@ -0,0 +1,217 @@
+#include "Floppy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "PackedImage.h"
+#include "common/FileUtil.h"
+#include "common/MappedFile.h"
+
+Floppy::Floppy(std::string name, std::vector<uint8_t> const & image) :
+	name(std::move(name)),
+	sectors(),
+	imageSize(0)
+{
+	setImage(image);
+}
+
+Floppy Floppy::open(std::string const & filename, bool writeBack)
+{
+	Floppy floppy;
+	floppy.name = filename;
+
+	floppy.baseSize = getFileSize(filename);
+	if (floppy.baseSize != 0) {
+		floppy.base = mapFile(filename, 0, floppy.baseSize);
+	}
+	floppy.imageSize = floppy.baseSize;
+
+	if (PackedImage::isPacked(floppy.base.get(), floppy.baseSize)) {
+		floppy.packed = std::make_shared<PackedImage>(floppy.base, floppy.baseSize);
+		floppy.imageSize = floppy.packed->getImageSize();
+		floppy.base.reset();
+		floppy.baseSize = 0;
+	}
+	floppy.sectors.resize((floppy.imageSize + sectorSize - 1) / sectorSize);
+	floppy.dirty.resize(floppy.sectors.size());
+
+	if (writeBack) {
+		floppy.writeBackFile = filename;
+	}
+
+	return floppy;
+}
+
+bool Floppy::readSector(unsigned sector, uint8_t * data) const
+{
+	if (imageSize < (sector + 1) * std::size_t(sectorSize)) {
+		return false;
+	}
+
+	Sector const * stored = sectors[sector].get();
+	if (stored == nullptr) {
+		readBaseSector(sector, data);
+	} else {
+		std::copy(stored->begin(), stored->end(), data);
+	}
+
+	return true;
+}
+
+void Floppy::writeSector(unsigned sector, uint8_t const * data)
+{
+	imageSize = std::max(imageSize, (sector + 1) * std::size_t(sectorSize));
+	if (sectors.size() <= sector) {
+		sectors.resize(sector + 1);
+		dirty.resize(sector + 1);
+	}
+
+	std::shared_ptr<Sector> & stored = sectors[sector];
+	if (stored.use_count() == 1) {
+		// Other copies that shared the sector are done reading it
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} else {
+		stored = std::make_shared<Sector>();
+	}
+
+	std::copy(data, data + sectorSize, stored->begin());
+	dirty[sector] = true;
+}
+
+std::vector<uint8_t> Floppy::getImage() const
+{
+	std::vector<uint8_t> image(imageSize);
+
+	for (std::size_t i = 0; i < sectors.size(); ++i) {
+		std::size_t const start = i * sectorSize;
+		std::size_t const length = std::min<std::size_t>(sectorSize, imageSize - start);
+
+		if (sectors[i] != nullptr) {
+			std::copy(sectors[i]->begin(), sectors[i]->begin() + length, image.begin() + start);
+		} else {
+			Sector sector;
+			readBaseSector(i, sector.data());
+			std::copy(sector.begin(), sector.begin() + length, image.begin() + start);
+		}
+	}
+
+	return image;
+}
+
+void Floppy::setImage(std::vector<uint8_t> const & image)
+{
+	base.reset();
+	baseSize = 0;
+	packed.reset();
+	writeBackFile.clear();
+
+	imageSize = image.size();
+	sectors.assign((imageSize + sectorSize - 1) / sectorSize, nullptr);
+	dirty.assign(sectors.size(), false);
+
+	for (std::size_t i = 0; i < sectors.size(); ++i) {
+		std::size_t const start = i * sectorSize;
+		std::size_t const length = std::min<std::size_t>(sectorSize, imageSize - start);
+
+		auto const begin = image.begin() + start;
+		if (std::all_of(begin, begin + length, [](uint8_t value) { return value == 0; })) {
+			continue;
+		}
+
+		sectors[i] = std::make_shared<Sector>();
+		sectors[i]->fill(0);
+		std::copy(begin, begin + length, sectors[i]->begin());
+	}
+}
+
+void Floppy::sync()
+{
+	if (writeBackFile.empty() || std::find(dirty.begin(), dirty.end(), true) == dirty.end()) {
+		return;
+	}
+
+	if (packed) {
+		writeBackPacked();
+		return;
+	}
+
+	std::fstream file(writeBackFile, std::ios::binary | std::ios::in | std::ios::out);
+
+	std::vector<uint8_t> run;
+	for (std::size_t first = 0; file && first < dirty.size(); ++first) {
+		if (!dirty[first]) {
+			continue;
+		}
+
+		std::size_t last = first;
+		while (last + 1 < dirty.size() && dirty[last + 1]) {
+			++last;
+		}
+
+		run.resize((last - first + 1) * sectorSize);
+		for (std::size_t i = first; i <= last; ++i) {
+			std::copy(sectors[i]->begin(), sectors[i]->end(), run.begin() + (i - first) * sectorSize);
+		}
+
+		file.seekp(first * sectorSize);
+		file.write(reinterpret_cast<char const *>(run.data()), run.size());
+
+		first = last;
+	}
+
+	if (!file.flush()) {
+		throw std::runtime_error(
+			std::string("Unable to write disk image '") + writeBackFile + "'");
+	}
+
+	dirty.assign(dirty.size(), false);
+}
+
+void Floppy::stopWriteBack()
+{
+	writeBackFile.clear();
+}
+
+void Floppy::writeBackPacked()
+{
+	// The file stays mapped, so the new one replaces it rather than
+	// overwriting it
+	std::string const temporary = writeBackFile + ".tmp";
+	saveFile(temporary, PackedImage::pack(getImage()));
+	if (std::rename(temporary.c_str(), writeBackFile.c_str()) != 0) {
+		throw std::runtime_error(
+			std::string("Unable to replace disk image '") + writeBackFile + "'");
+	}
+
+	dirty.assign(dirty.size(), false);
+}
+
+void Floppy::readBaseSector(unsigned sector, uint8_t * data) const
+{
+	if (packed) {
+		uint32_t const payload = sector < packed->getSectorCount() ? packed->getPayload(sector) : 0;
+		if (payload == 0) {
+			std::fill(data, data + sectorSize, 0);
+			return;
+		}
+
+		CachedSector & cached = cache[payload % cacheSize];
+		if (cached.payload != payload) {
+			packed->readPayload(payload, cached.data.data());
+			cached.payload = payload;
+		}
+		std::copy(cached.data.begin(), cached.data.end(), data);
+		return;
+	}
+
+	std::size_t const start = sector * std::size_t(sectorSize);
+	std::size_t const length = start < baseSize ? std::min<std::size_t>(sectorSize, baseSize - start) : 0;
+
+	if (length != 0) {
+		std::copy(base.get() + start, base.get() + start + length, data);
+	}
+	std::fill(data + length, data + sectorSize, 0);
+}
@@ -1,25 +1,78 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+class PackedImage;
+
+// A disk image stored as 128 byte sectors. Copies share their sectors
+// until one of them writes a sector, so copying a floppy costs a
+// reference per sector rather than the whole image.
 class Floppy
 {
 public:
+	static unsigned const sectorSize = 128;
+
 	Floppy() = default;
+	Floppy(std::string name, std::vector<uint8_t> const & image);
 
-	Floppy(std::string name, std::vector<uint8_t> image) :
-		name(std::move(name)),
-		image(std::move(image))
-	{}
+	// Maps the image file, raw or packed, sectors are read from it on
+	// first access. With writeBack, sync() writes the sectors written
+	// since back to the file. Copies share the mapping, which shows
+	// what sync() wrote to sectors they did not write themselves, so
+	// only write back disks that are not copied. Throws
+	// std::runtime_error if the file cannot be opened.
+	static Floppy open(std::string const & filename, bool writeBack);
 
 	std::string const & getName() const { return name; };
-	std::vector<uint8_t> const & getImage() const { return image; };
-	std::vector<uint8_t> & getImage() { return image; };
-
 	void setName(std::string name) { this->name = std::move(name); };
-	void setImage(std::vector<uint8_t> image) { this->image = std::move(image); };
+
+	// Returns false unless the whole sector is within the image
+	bool readSector(unsigned sector, uint8_t * data) const;
+	// Grows the image up to the end of the sector if needed
+	void writeSector(unsigned sector, uint8_t const * data);
+
+	std::vector<uint8_t> getImage() const;
+	// Also stops writing back
+	void setImage(std::vector<uint8_t> const & image);
+
+	// Writes the dirty sectors to the image file, each run of adjacent
+	// ones at once, or replaces a packed file with a repacked one. Does
+	// nothing unless opened for write back, throws std::runtime_error if
+	// the file cannot be written.
+	void sync();
+	void stopWriteBack();
 private:
+	typedef std::array<uint8_t, sectorSize> Sector;
+
+	// Copies a sector that was never written from the image file
+	void readBaseSector(unsigned sector, uint8_t * data) const;
+	void writeBackPacked();
+
 	std::string name;
-	std::vector<uint8_t> image;
+
+	// A null sector reads from the image file, as zeros past its end
+	std::vector<std::shared_ptr<Sector>> sectors;
+	std::size_t imageSize = 0;
+
+	std::shared_ptr<uint8_t const> base;
+	std::size_t baseSize = 0;
+
+	// Instead of base for a packed file, with the sectors decompressed
+	// last by payload
+	struct CachedSector {
+		uint32_t payload = 0;
+		Sector data;
+	};
+	static unsigned const cacheSize = 16;
+
+	std::shared_ptr<PackedImage const> packed;
+	mutable std::array<CachedSector, cacheSize> cache;
+
+	// Set by writeSector() until the next sync()
+	std::vector<bool> dirty;
+	std::string writeBackFile;
 };
@@ -1,15 +1,30 @@
 #include "FloppyDrive.h"
 
+#include <vector>
+
+#include "common/StateStream.h"
+
 FloppyDrive::FloppyDrive(RedbusNetwork & network, uint8_t address) :
 	RedbusDevice(network, address),
 	dataBuffer(),
 	disk(),
 	ejected(true),
-	regs{0, 0}
+	regs{0, 0, 1, 0}
 {}
 
+FloppyDrive::FloppyDrive(RedbusNetwork & network, FloppyDrive const & other) :
+	RedbusDevice(network, other.getAddress()),
+	dataBuffer(other.dataBuffer),
+	disk(other.disk),
+	ejected(other.ejected),
+	regs(other.regs)
+{
+	disk.stopWriteBack();
+}
+
 void FloppyDrive::setDisk(Floppy floppy)
 {
+	disk.sync();
 	disk = std::move(floppy);
 	ejected = false;
 }
@@ -21,9 +36,46 @@ Floppy const & FloppyDrive::getDisk() const
 
 void FloppyDrive::ejectDisk()
 {
+	disk.sync();
 	ejected = true;
 }
 
+void FloppyDrive::syncDisk()
+{
+	disk.sync();
+}
+
+void FloppyDrive::saveState(StateWriter & out) const
+{
+	out.u8(getAddress());
+	out.bytes(dataBuffer.data(), dataBuffer.size());
+	out.u8(regs.command);
+	out.u16(regs.sector);
+
+	out.boolean(ejected);
+	out.string(disk.getName());
+	out.blob(disk.getImage());
+
+	out.u8(regs.count);
+	out.u8(regs.memoryDevice);
+}
+
+void FloppyDrive::loadState(StateReader & in)
+{
+	setAddress(in.u8());
+	in.bytes(dataBuffer.data(), dataBuffer.size());
+	regs.command = in.u8();
+	regs.sector = in.u16();
+
+	ejected = in.boolean();
+	disk.setName(in.string());
+	disk.setImage(in.blob());
+
+	// Added with the multi-sector commands
+	regs.count = in.atEnd() ? 1 : in.u8();
+	regs.memoryDevice = in.atEnd() ? 0 : in.u8();
+}
+
 uint8_t FloppyDrive::read(uint8_t address)
 {
 	if (address < 128) {
@@ -37,6 +89,10 @@ uint8_t FloppyDrive::read(uint8_t address)
 		return regs.sector >> 8;
 	case 0x82:
 		return regs.command;
+	case 0x83:
+		return regs.count;
+	case 0x84:
+		return regs.memoryDevice;
 	default:
 		return 0;
 	}
@@ -60,11 +116,24 @@ void FloppyDrive::write(uint8_t address, uint8_t value)
 		regs.command = value;
 		executeCommand(); // For now, execute immediately
 		break;
+	case 0x83:
+		regs.count = value;
+		break;
+	case 0x84:
+		regs.memoryDevice = value;
+		break;
 	default:
 		break;
 	}
 }
 
+void FloppyDrive::mapMemory(MemoryMap & map)
+{
+	for (unsigned i = 0; i < dataBuffer.size(); ++i) {
+		map[i] = &dataBuffer[i];
+	}
+}
+
 void FloppyDrive::readDiskNameCommand()
 {
 	dataBuffer.fill(0);
@@ -111,18 +180,11 @@ void FloppyDrive::readDiskSectorCommand()
 		return;
 	}
 
-	unsigned const sectorStart = regs.sector * 128;
-	auto const & image = disk.getImage();
-
-	if (image.size() < sectorStart + 128) {
+	if (!disk.readSector(regs.sector, dataBuffer.data())) {
 		regs.command = uint8_t(-1);
 		return;
 	}
 
-	for (unsigned i = 0; i < dataBuffer.size(); ++i) {
-		dataBuffer[i] = image[sectorStart + i];
-	}
-
 	regs.command = 0;
 }
 
@@ -133,15 +195,51 @@ void FloppyDrive::writeDiskSectorCommand()
 		return;
 	}
 
-	unsigned const sectorStart = regs.sector * 128;
-	auto & image = disk.getImage();
+	disk.writeSector(regs.sector, dataBuffer.data());
+
+	regs.command = 0;
+}
+
+void FloppyDrive::readDiskSectorsCommand()
+{
+	RedbusDevice * memory = findDevice(regs.memoryDevice);
+	if (regs.count == 0 || regs.sector + regs.count - 1 > 2048 || memory == nullptr) {
+		regs.command = uint8_t(-1);
+		return;
+	}
 
-	if (image.size() < sectorStart + 128) {
-		image.resize(sectorStart + 128);
+	std::vector<uint8_t> data(regs.count * Floppy::sectorSize);
+	for (unsigned i = 0; i < regs.count; ++i) {
+		if (!disk.readSector(regs.sector + i, &data[i * Floppy::sectorSize])) {
+			regs.command = uint8_t(-1);
+			return;
+		}
 	}
 
-	for (unsigned i = 0; i < dataBuffer.size(); ++i) {
-		image[sectorStart + i] = dataBuffer[i];
+	if (!memory->writeExternalMemory(0, data.data(), data.size())) {
+		regs.command = uint8_t(-1);
+		return;
+	}
+
+	regs.command = 0;
+}
+
+void FloppyDrive::writeDiskSectorsCommand()
+{
+	RedbusDevice * memory = findDevice(regs.memoryDevice);
+	if (regs.count == 0 || regs.sector + regs.count - 1 > 2048 || memory == nullptr) {
+		regs.command = uint8_t(-1);
+		return;
+	}
+
+	std::vector<uint8_t> data(regs.count * Floppy::sectorSize);
+	if (!memory->readExternalMemory(0, data.data(), data.size())) {
+		regs.command = uint8_t(-1);
+		return;
+	}
+
+	for (unsigned i = 0; i < regs.count; ++i) {
+		disk.writeSector(regs.sector + i, &data[i * Floppy::sectorSize]);
 	}
 
 	regs.command = 0;
@@ -167,6 +265,10 @@ void FloppyDrive::executeCommand()
 		readDiskSectorCommand(); break;
 	case 5:
 		writeDiskSectorCommand(); break;
+	case 6:
+		readDiskSectorsCommand(); break;
+	case 7:
+		writeDiskSectorsCommand(); break;
 	default:
 		regs.command = uint8_t(-1);
 	}
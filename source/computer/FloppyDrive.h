@@ -8,26 +8,45 @@
 #include "RedbusDevice.h"
 #include "RedbusNetwork.h"
 
+class StateReader;
+class StateWriter;
+
 class FloppyDrive : public RedbusDevice
 {
 public:
 	FloppyDrive(RedbusNetwork & network, uint8_t address);
+	// Copies the state of other onto network, the disk shares its
+	// sectors until written and is not written back
+	FloppyDrive(RedbusNetwork & network, FloppyDrive const & other);
 
+	// Syncs the disk in the drive before replacing or ejecting it
 	void setDisk(Floppy floppy);
 	Floppy const & getDisk() const;
 	void ejectDisk();
+	// Writes the disk back to its image file, see Floppy::sync()
+	void syncDisk();
+
+	// Includes the disk in the drive
+	void saveState(StateWriter & out) const;
+	void loadState(StateReader & in);
 
 	uint8_t read(uint8_t address) override;
 	void write(uint8_t address, uint8_t value) override;
+	// The data buffer
+	void mapMemory(MemoryMap & map) override;
 private:
 	void readDiskNameCommand();
 	void writeDiskNameCommand();
 	void readDiskSerialCommand();
 	void readDiskSectorCommand();
 	void writeDiskSectorCommand();
+	// Transfer regs.count sectors from regs.sector on between the disk
+	// and the external memory window of the device at regs.memoryDevice
+	void readDiskSectorsCommand();
+	void writeDiskSectorsCommand();
 	void executeCommand();
 
-	std::array<uint8_t, 128> dataBuffer;
+	std::array<uint8_t, Floppy::sectorSize> dataBuffer;
 
 	Floppy disk;
 	bool ejected;
@@ -35,5 +54,7 @@ private:
 	struct {
 		uint8_t command;
 		uint16_t sector;
+		uint8_t count;
+		uint8_t memoryDevice;
 	} regs;
 };
@@ -0,0 +1,267 @@
+#include "PackedImage.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <stdexcept>
+
+#include "common/StateStream.h"
+
+namespace {
+
+char const packedMagic[8] = {'E', 'F', 'P', 'C', 'D', 'I', 'S', 'K'};
+uint32_t const packedVersion = 1;
+uint32_t const headerSize = 40;
+
+typedef std::array<uint8_t, PackedImage::sectorSize> Sector;
+
+uint32_t readU32(uint8_t const * data)
+{
+	return data[0] | data[1] << 8 | data[2] << 16 | uint32_t(data[3]) << 24;
+}
+
+// Sectors are compressed on their own as a sequence of tokens. A token
+// below 0x80 is followed by that many plus one literal bytes. Any other
+// token copies (token & 0x7f) + 3 bytes from a distance given by the
+// next byte, the copy may overlap what it writes.
+unsigned const minMatch = 3;
+unsigned const maxMatch = 0x7f + minMatch;
+unsigned const maxLiterals = 0x80;
+
+std::vector<uint8_t> compress(Sector const & sector)
+{
+	std::vector<uint8_t> out;
+	std::size_t literals = 0;
+
+	auto flushLiterals = [&](std::size_t end) {
+		while (literals > 0) {
+			std::size_t const count = std::min<std::size_t>(literals, maxLiterals);
+			std::size_t const start = end - literals;
+			out.push_back(count - 1);
+			out.insert(out.end(), sector.begin() + start, sector.begin() + start + count);
+			literals -= count;
+		}
+	};
+
+	std::size_t position = 0;
+	while (position < sector.size()) {
+		std::size_t bestLength = 0;
+		std::size_t bestDistance = 0;
+		for (std::size_t distance = 1; distance <= position && distance <= 0xff; ++distance) {
+			std::size_t length = 0;
+			while (position + length < sector.size() && length < maxMatch
+					&& sector[position + length] == sector[position + length - distance]) {
+				++length;
+			}
+			if (length > bestLength) {
+				bestLength = length;
+				bestDistance = distance;
+			}
+		}
+
+		if (bestLength < minMatch) {
+			++literals;
+			++position;
+			continue;
+		}
+
+		flushLiterals(position);
+		out.push_back(0x80 | (bestLength - minMatch));
+		out.push_back(bestDistance);
+		position += bestLength;
+	}
+	flushLiterals(position);
+
+	return out;
+}
+
+// Returns false unless data holds exactly one sector
+bool decompress(uint8_t const * data, std::size_t size, uint8_t * sector)
+{
+	std::size_t in = 0;
+	std::size_t out = 0;
+
+	while (in < size) {
+		uint8_t const token = data[in++];
+		if (token < 0x80) {
+			std::size_t const count = token + 1u;
+			if (in + count > size || out + count > PackedImage::sectorSize) {
+				return false;
+			}
+			std::copy(data + in, data + in + count, sector + out);
+			in += count;
+			out += count;
+		} else {
+			std::size_t const length = (token & 0x7f) + minMatch;
+			if (in == size) {
+				return false;
+			}
+			std::size_t const distance = data[in++];
+			if (distance == 0 || distance > out || out + length > PackedImage::sectorSize) {
+				return false;
+			}
+			for (std::size_t i = 0; i < length; ++i, ++out) {
+				sector[out] = sector[out - distance];
+			}
+		}
+	}
+
+	return out == PackedImage::sectorSize;
+}
+
+}
+
+bool PackedImage::isPacked(uint8_t const * data, std::size_t size)
+{
+	return size >= sizeof(packedMagic)
+		&& std::equal(data, data + sizeof(packedMagic), reinterpret_cast<uint8_t const *>(packedMagic));
+}
+
+std::vector<uint8_t> PackedImage::pack(std::vector<uint8_t> const & image)
+{
+	uint32_t const sectors = (image.size() + sectorSize - 1) / sectorSize;
+
+	std::map<Sector, uint32_t> known;
+	std::vector<uint32_t> index(sectors, 0);
+	std::vector<uint32_t> ends;
+	std::vector<uint8_t> payloads;
+
+	for (uint32_t i = 0; i < sectors; ++i) {
+		Sector sector;
+		sector.fill(0);
+		std::size_t const start = i * std::size_t(sectorSize);
+		std::size_t const length = std::min<std::size_t>(sectorSize, image.size() - start);
+		std::copy(image.begin() + start, image.begin() + start + length, sector.begin());
+
+		if (std::all_of(sector.begin(), sector.end(), [](uint8_t value) { return value == 0; })) {
+			continue;
+		}
+
+		auto const found = known.find(sector);
+		if (found != known.end()) {
+			index[i] = found->second;
+			continue;
+		}
+
+		// Stored as is unless compression pays off
+		std::vector<uint8_t> compressed = compress(sector);
+		if (compressed.size() >= sectorSize) {
+			compressed.assign(sector.begin(), sector.end());
+		}
+
+		payloads.insert(payloads.end(), compressed.begin(), compressed.end());
+		ends.push_back(payloads.size());
+
+		index[i] = ends.size();
+		known.emplace(sector, index[i]);
+	}
+
+	StateWriter out;
+	out.bytes(reinterpret_cast<uint8_t const *>(packedMagic), sizeof(packedMagic));
+	out.u32(packedVersion);
+	out.u32(headerSize);
+	out.u64(image.size());
+	out.u32(sectors);
+	out.u32(ends.size());
+	out.u64(headerSize + (index.size() + ends.size()) * 4);
+
+	for (uint32_t payload : index) {
+		out.u32(payload);
+	}
+	for (uint32_t end : ends) {
+		out.u32(end);
+	}
+	out.bytes(payloads.data(), payloads.size());
+
+	return out.getData();
+}
+
+PackedImage::PackedImage(std::shared_ptr<uint8_t const> data, std::size_t size) :
+	data(std::move(data)),
+	size(size),
+	imageSize(0),
+	sectorCount(0),
+	payloadCount(0),
+	index(nullptr),
+	payloadEnds(nullptr),
+	payloads(nullptr)
+{
+	StateReader header(this->data.get(), size);
+
+	uint8_t magic[sizeof(packedMagic)];
+	header.bytes(magic, sizeof(magic));
+	if (!isPacked(magic, sizeof(magic))) {
+		throw std::runtime_error("Not a packed disk image");
+	}
+	if (header.u32() != packedVersion || header.u32() != headerSize) {
+		throw std::runtime_error("Unsupported packed disk image version");
+	}
+
+	imageSize = header.u64();
+	sectorCount = header.u32();
+	payloadCount = header.u32();
+	uint64_t const payloadOffset = header.u64();
+
+	uint64_t const tablesSize = (uint64_t(sectorCount) + payloadCount) * 4;
+	if (sectorCount != (imageSize + sectorSize - 1) / sectorSize
+			|| payloadOffset != headerSize + tablesSize || payloadOffset > size) {
+		throw std::runtime_error("Packed disk image is truncated or malformed");
+	}
+
+	index = this->data.get() + headerSize;
+	payloadEnds = index + sectorCount * 4;
+	payloads = this->data.get() + payloadOffset;
+
+	uint32_t start = 0;
+	for (uint32_t payload = 1; payload <= payloadCount; ++payload) {
+		uint32_t const end = readU32(payloadEnds + (payload - 1) * 4);
+		if (end <= start || end - start > sectorSize || payloadOffset + end > size) {
+			throw std::runtime_error("Packed disk image is truncated or malformed");
+		}
+
+		uint8_t sector[sectorSize];
+		if (end - start < sectorSize && !decompress(payloads + start, end - start, sector)) {
+			throw std::runtime_error("Packed disk image has a corrupt sector");
+		}
+
+		start = end;
+	}
+
+	for (uint32_t sector = 0; sector < sectorCount; ++sector) {
+		if (getPayload(sector) > payloadCount) {
+			throw std::runtime_error("Packed disk image is truncated or malformed");
+		}
+	}
+}
+
+uint32_t PackedImage::getPayload(uint32_t sector) const
+{
+	return readU32(index + sector * 4);
+}
+
+void PackedImage::readPayload(uint32_t payload, uint8_t * sector) const
+{
+	uint32_t const start = payload == 1 ? 0 : readU32(payloadEnds + (payload - 2) * 4);
+	uint32_t const end = readU32(payloadEnds + (payload - 1) * 4);
+
+	if (end - start == sectorSize) {
+		std::copy(payloads + start, payloads + end, sector);
+	} else {
+		decompress(payloads + start, end - start, sector);
+	}
+}
+
+std::vector<uint8_t> PackedImage::unpack() const
+{
+	std::vector<uint8_t> image(sectorCount * std::size_t(sectorSize), 0);
+
+	for (uint32_t sector = 0; sector < sectorCount; ++sector) {
+		uint32_t const payload = getPayload(sector);
+		if (payload != 0) {
+			readPayload(payload, &image[sector * std::size_t(sectorSize)]);
+		}
+	}
+
+	image.resize(imageSize);
+	return image;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A disk image container that leaves out zero sectors and stores every
+// other distinct sector once, compressed, behind a sector index. See
+// docs/disk.md for the layout.
+class PackedImage
+{
+public:
+	static unsigned const sectorSize = 128;
+
+	static bool isPacked(uint8_t const * data, std::size_t size);
+	// Builds the container for a raw image, a partial last sector is
+	// padded with zeros
+	static std::vector<uint8_t> pack(std::vector<uint8_t> const & image);
+
+	// Parses the size bytes of data, kept alive by data. Checks every
+	// payload once, throws std::runtime_error if the container is
+	// malformed.
+	PackedImage(std::shared_ptr<uint8_t const> data, std::size_t size);
+
+	// Of the raw image
+	std::size_t getImageSize() const { return imageSize; };
+	uint32_t getSectorCount() const { return sectorCount; };
+	uint32_t getPayloadCount() const { return payloadCount; };
+
+	// Identical sectors share a payload, 0 stands for a zero sector
+	uint32_t getPayload(uint32_t sector) const;
+	// Decompresses a payload other than 0 into sectorSize bytes
+	void readPayload(uint32_t payload, uint8_t * sector) const;
+
+	std::vector<uint8_t> unpack() const;
+private:
+	std::shared_ptr<uint8_t const> data;
+	std::size_t size;
+
+	std::size_t imageSize;
+	uint32_t sectorCount;
+	uint32_t payloadCount;
+
+	// Into data
+	uint8_t const * index;
+	uint8_t const * payloadEnds;
+	uint8_t const * payloads;
+};
@@ -1,16 +1,119 @@
 #include "Processor.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <iostream>
+#include <stdexcept>
 #include <thread>
 
+#include "BlockCompiler.h"
+#include "Profiler.h"
+#include "Tracer.h"
 #include "common/FileUtil.h"
+#include "common/StateStream.h"
 
 std::string const Processor::bootImagePath = "resources/rpcboot.bin";
 unsigned const Processor::bootImageOffset = 1024;
 unsigned const Processor::bootImageSize = 256;
-unsigned const Processor::cyclesPerTick = 10 * 1000;
+unsigned const Processor::defaultCyclesPerTick = 10 * 1000;
+
+namespace {
+
+// Helpers for the private register and MMU structs
+template <typename Registers>
+bool sameRegisters(Registers const & a, Registers const & b)
+{
+	return a.A == b.A && a.B == b.B && a.X == b.X && a.Y == b.Y && a.D == b.D
+		&& a.SP == b.SP && a.PC == b.PC && a.R == b.R && a.I == b.I;
+}
+
+template <typename Mmu>
+bool sameMmu(Mmu const & a, Mmu const & b)
+{
+	return a.redbusAddress == b.redbusAddress
+		&& a.redbusWindow == b.redbusWindow
+		&& a.externalWindow == b.externalWindow
+		&& a.redbusEnabled == b.redbusEnabled
+		&& a.externalWindowEnabled == b.externalWindowEnabled;
+}
+
+// Cycle costs in accurate clock mode, following 65C816 timings with
+// 8-bit registers. The 65EL02 extensions are costed like their closest
+// 65C816 counterpart (NXT like JMP (abs), ENT like JSR, R-stack
+// relative like stack relative). Unimplemented opcodes cost nothing,
+// they halt the processor.
+uint8_t const baseCycles[256] = {
+//	x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 xa xb xc xd xe xf
+	0, 6, 5, 4, 5, 3, 5, 4, 0, 2, 0, 4, 6, 4, 6, 8, // 0x
+	2, 5, 5, 7, 5, 4, 6, 7, 2, 4, 2, 0, 6, 4, 7, 9, // 1x
+	0, 6, 6, 4, 0, 3, 0, 4, 0, 2, 2, 5, 0, 4, 0, 9, // 2x
+	2, 5, 5, 7, 0, 4, 0, 7, 2, 4, 2, 0, 0, 4, 0, 9, // 3x
+	0, 6, 4, 4, 0, 3, 0, 4, 3, 2, 0, 3, 3, 4, 0,14, // 4x
+	2, 5, 5, 7, 0, 4, 0, 7, 0, 4, 3, 0, 2, 4, 0,15, // 5x
+	6, 6, 0, 4, 3, 3, 0, 4, 4, 2, 2, 4, 0, 4, 0,15, // 6x
+	2, 5, 5, 7, 0, 4, 0, 7, 0, 4, 4, 0, 0, 4, 0,15, // 7x
+	3, 6, 0, 4, 0, 3, 0, 4, 2, 0, 2, 2, 0, 4, 0, 2, // 8x
+	2, 6, 5, 7, 0, 4, 0, 7, 0, 5, 2, 0, 0, 5, 0, 0, // 9x
+	2, 6, 2, 4, 0, 3, 0, 0, 2, 2, 2, 0, 0, 4, 0, 0, // ax
+	2, 0, 0, 0, 0, 4, 0, 0, 0, 0, 2, 2, 0, 0, 0, 0, // bx
+	0, 6, 3, 4, 0, 3, 0, 4, 0, 2, 2, 3, 0, 4, 0, 4, // cx
+	2, 5, 5, 7, 0, 4, 0, 7, 0, 4, 3, 0, 2, 4, 0, 3, // dx
+	0, 0, 3, 4, 0, 0, 5, 0, 2, 0, 0, 0, 0, 0, 6, 3, // ex
+	2, 0, 0, 0, 5, 0, 6, 0, 0, 0, 4, 2, 0, 0, 7, 0  // fx
+};
+
+// Extra cycles with 16-bit operands: M and X add one cycle when the
+// accumulator or index registers are 16-bit, W adds two (read-modify-
+// write of an accumulator sized value).
+char const widenedBy[] =
+//	 0123456789abcdef
+	"-M-MWMWM-M--WMWM" // 0x
+	"-MMMWMWM-M--WMWM" // 1x
+	"-M-M-M-M-M---M-M" // 2x
+	"-MMM-M-M-M---M-M" // 3x
+	"-MMM-M-MMM-M-M-M" // 4x
+	"-MMM-M-M-MX--M-M" // 5x
+	"-M-MMM-MMM-M-M-M" // 6x
+	"-MMM-M-M-MX--M-M" // 7x
+	"-M-MXMXM----XMX-" // 8x
+	"-MMMXMXM-M---M--" // 9x
+	"XMXMXMX--M--XMX-" // ax
+	"-M--XMX--M--XMX-" // bx
+	"XM-MXM-M-M--XM-M" // cx
+	"-MMM-M-M-MX--M-M" // dx
+	"XM-MXMW--M--XMW-" // ex
+	"-M---MW--MX--MW-"; // fx
+
+uint8_t cycleCost(uint8_t opcode, bool flagM, bool flagX)
+{
+	uint8_t cycles = baseCycles[opcode];
+	switch (widenedBy[opcode]) {
+	case 'M':
+		cycles += flagM ? 0 : 1; break;
+	case 'X':
+		cycles += flagX ? 0 : 1; break;
+	case 'W':
+		cycles += flagM ? 0 : 2; break;
+	default:
+		break;
+	}
+	return cycles;
+}
+
+}
+
+std::array<Processor::InstructionSet, 8> const Processor::instructionSets = {{
+	Processor::buildInstructionSet<false, false, false>(),
+	Processor::buildInstructionSet<false, false, true>(),
+	Processor::buildInstructionSet<false, true, false>(),
+	Processor::buildInstructionSet<false, true, true>(),
+	Processor::buildInstructionSet<true, false, false>(),
+	Processor::buildInstructionSet<true, false, true>(),
+	Processor::buildInstructionSet<true, true, false>(),
+	Processor::buildInstructionSet<true, true, true>()
+}};
 
 Processor::Processor(RedbusNetwork & network, unsigned memoryBanks, uint8_t address) :
 	RedbusDevice(network, address),
@@ -19,21 +122,143 @@ Processor::Processor(RedbusNetwork & network, unsigned memoryBanks, uint8_t addr
 	regs{0, 0, 0, 0, 0, 0, 0, 0, 0},
 	mmu{0, 0, 0, false, false},
 	flags(0),
+	signResult(0),
+	zeroResult(1),
+	carry(false),
+	overflow(false),
+	mode(0),
+	instructions(&instructionSets[0]),
 	brkAddress(8192),
 	porAddress(8192),
 	ticks(0),
 	remainingCycles(0),
+	instructionCount(0),
+	cyclesPerTick(defaultCyclesPerTick),
+	clockMode(ClockMode::Fast),
 	isRunning(false),
 	rbTimeout(false),
 	waiTimeout(false),
-	rbCache(nullptr)
+	rbWritten(false),
+	watchWrites(false),
+	memoryWritten(false),
+	quiescent(false),
+	rbCache(nullptr),
+	rbMap(nullptr),
+	rbAccessed(false),
+	deviceSwitchYields(true),
+	decodeCache(),
+	codePages(),
+	pages(),
+	ramPages(),
+	jit(),
+	profiler(),
+	tracer()
 {
 	assert(this->memoryBanks != 0);
 	assert(this->memoryBanks <= maxBankCount);
 
+	for (auto & page : memory) {
+		page.reset(new uint8_t[pageSize](), std::default_delete<uint8_t[]>());
+	}
+
 	coldBoot();
 }
 
+Processor::Processor(RedbusNetwork & network, Processor & parent) :
+	RedbusDevice(network, parent.getAddress()),
+	memory(parent.memory),
+	memoryBanks(parent.memoryBanks),
+	regs(parent.regs),
+	mmu(parent.mmu),
+	flags(parent.flags),
+	signResult(parent.signResult),
+	zeroResult(parent.zeroResult),
+	carry(parent.carry),
+	overflow(parent.overflow),
+	mode(parent.mode),
+	instructions(parent.instructions),
+	brkAddress(parent.brkAddress),
+	porAddress(parent.porAddress),
+	ticks(parent.ticks),
+	remainingCycles(parent.remainingCycles),
+	instructionCount(parent.instructionCount),
+	cyclesPerTick(parent.cyclesPerTick),
+	clockMode(parent.clockMode),
+	isRunning(parent.isRunning),
+	rbTimeout(parent.rbTimeout),
+	waiTimeout(parent.waiTimeout),
+	rbWritten(parent.rbWritten),
+	watchWrites(false),
+	memoryWritten(false),
+	quiescent(false),
+	rbCache(nullptr),
+	rbMap(nullptr),
+	rbAccessed(false),
+	deviceSwitchYields(parent.deviceSwitchYields),
+	decodeCache(),
+	codePages(),
+	pages(),
+	ramPages(),
+	jit(),
+	profiler(),
+	tracer()
+{
+	// Both sides now go through the slow path to write shared pages
+	parent.updatePageTable();
+	updatePageTable();
+
+	if (parent.jit) {
+		setJitEnabled(true);
+	}
+}
+
+Processor::~Processor() = default;
+
+bool Processor::setJitEnabled(bool enabled)
+{
+	if (!enabled) {
+		jit.reset();
+		return true;
+	}
+
+	if (!BlockCompiler::isSupported()) {
+		return false;
+	}
+
+	if (!jit) {
+		jit.reset(new BlockCompiler(*this));
+	}
+	return true;
+}
+
+void Processor::setProfiling(bool enabled)
+{
+	if (!enabled) {
+		profiler.reset();
+	} else if (!profiler) {
+		profiler.reset(new Profiler());
+	}
+}
+
+Profiler * Processor::getProfiler() const
+{
+	return profiler.get();
+}
+
+void Processor::setTracing(std::size_t capacity)
+{
+	if (capacity == 0) {
+		tracer.reset();
+	} else {
+		tracer.reset(new Tracer(capacity));
+	}
+}
+
+Tracer * Processor::getTracer() const
+{
+	return tracer.get();
+}
+
 void Processor::coldBoot()
 {
 	brkAddress = porAddress = 8192;
@@ -42,15 +267,19 @@ void Processor::coldBoot()
 	regs.R = 768;
 
 	regs.A = regs.X = regs.Y = regs.D = 0;
-	flags = 0;
+	unpackFlags(0);
 	setFlag(FlagE);
 	setFlag(FlagM);
 	setFlag(FlagX);
+	updateMode();
 
-	memory[0] = 2; // Disk
-	memory[1] = 1; // Console
+	uint8_t * const zeroPage = writablePage(0);
+	zeroPage[0] = 2; // Disk
+	zeroPage[1] = 1; // Console
 
 	loadBootImage();
+	flushInstructionCache();
+	updatePageTable();
 
 	remainingCycles = 0;
 	isRunning = false;
@@ -66,6 +295,7 @@ void Processor::warmBoot()
 
 	remainingCycles = 0;
 	isRunning = true;
+	quiescent = false;
 }
 
 void Processor::halt()
@@ -73,29 +303,250 @@ void Processor::halt()
 	isRunning = false;
 }
 
+uint64_t Processor::getInstructionCount() const
+{
+	return instructionCount;
+}
+
+uint32_t Processor::getTicks() const
+{
+	return ticks;
+}
+
+bool Processor::isHalted() const
+{
+	return !isRunning;
+}
+
+bool Processor::isWaiting() const
+{
+	return isRunning && waiTimeout;
+}
+
+bool Processor::isIdle() const
+{
+	return isWaiting() && !rbWritten;
+}
+
+bool Processor::isQuiescent() const
+{
+	return quiescent;
+}
+
 void Processor::runTick()
 {
 	++ticks;
 
 	if (!isRunning) {
+		quiescent = true;
 		return;
 	}
 
-	rbCache = nullptr;
+	// Only a tick following an idle one can turn out to change nothing,
+	// its writes all take the slow path to be noticed. Traced writes
+	// take it to be recorded.
+	bool const watch = isIdle() || tracer;
+	if (watchWrites != watch) {
+		watchWrites = watch;
+		updatePageTable();
+	}
+	memoryWritten = false;
+
+	Registers const oldRegs = regs;
+	Mmu const oldMmu = mmu;
+	uint16_t const oldFlags = packFlags();
+
+	bindRedbusDevice();
+	rbAccessed = false;
 	rbTimeout = false;
 	waiTimeout = false;
+	rbWritten = false;
 
+	// Cycles overspent by the last instruction of a tick are carried
+	// over as a debt.
 	remainingCycles += cyclesPerTick;
-	if (remainingCycles > 100 * cyclesPerTick) {
-		remainingCycles = 100 * cyclesPerTick;
+	if (remainingCycles > 100 * long(cyclesPerTick)) {
+		remainingCycles = 100 * long(cyclesPerTick);
+	}
+
+	if (profiler || tracer) {
+		runInstrumented();
+	} else if (jit) {
+		runCompiled();
+	} else {
+		while (isRunning
+			&& remainingCycles > 0
+			&& !waiTimeout
+			&& !rbTimeout)
+		{
+			processInstruction();
+		}
+	}
+
+	quiescent = watchWrites
+		&& isIdle()
+		&& !memoryWritten
+		&& packFlags() == oldFlags
+		&& sameRegisters(regs, oldRegs)
+		&& sameMmu(mmu, oldMmu);
+}
+
+void Processor::setClock(unsigned cyclesPerTick, ClockMode clockMode)
+{
+	assert(cyclesPerTick != 0);
+
+	this->cyclesPerTick = cyclesPerTick;
+	if (this->clockMode != clockMode) {
+		// Decoded instructions carry their cost
+		this->clockMode = clockMode;
+		flushInstructionCache();
+	}
+}
+
+void Processor::setDeviceSwitchYields(bool yields)
+{
+	deviceSwitchYields = yields;
+}
+
+bool Processor::getDeviceSwitchYields() const
+{
+	return deviceSwitchYields;
+}
+
+unsigned Processor::getCyclesPerTick() const
+{
+	return cyclesPerTick;
+}
+
+Processor::ClockMode Processor::getClockMode() const
+{
+	return clockMode;
+}
+
+void Processor::saveState(StateWriter & out) const
+{
+	out.u8(getAddress());
+	out.u8(memoryBanks);
+
+	out.u16(regs.A);
+	out.u8(regs.B);
+	out.u16(regs.X);
+	out.u16(regs.Y);
+	out.u16(regs.D);
+	out.u16(regs.SP);
+	out.u16(regs.PC);
+	out.u16(regs.R);
+	out.u16(regs.I);
+
+	out.u8(mmu.redbusAddress);
+	out.u16(mmu.redbusWindow);
+	out.u16(mmu.externalWindow);
+	out.boolean(mmu.redbusEnabled);
+	out.boolean(mmu.externalWindowEnabled);
+
+	out.u16(packFlags());
+	out.u16(brkAddress);
+	out.u16(porAddress);
+
+	out.u32(ticks);
+	out.u64(remainingCycles);
+	out.u64(instructionCount);
+	out.boolean(isRunning);
+	out.boolean(rbTimeout);
+	out.boolean(waiTimeout);
+}
+
+void Processor::loadState(StateReader & in)
+{
+	setAddress(in.u8());
+	if (in.u8() != memoryBanks) {
+		throw std::runtime_error("Machine state has a different number of memory banks");
+	}
+
+	regs.A = in.u16();
+	regs.B = in.u8();
+	regs.X = in.u16();
+	regs.Y = in.u16();
+	regs.D = in.u16();
+	regs.SP = in.u16();
+	regs.PC = in.u16();
+	regs.R = in.u16();
+	regs.I = in.u16();
+
+	mmu.redbusAddress = in.u8();
+	mmu.redbusWindow = in.u16();
+	mmu.externalWindow = in.u16();
+	mmu.redbusEnabled = in.boolean();
+	mmu.externalWindowEnabled = in.boolean();
+
+	unpackFlags(in.u16());
+	brkAddress = in.u16();
+	porAddress = in.u16();
+
+	ticks = in.u32();
+	remainingCycles = int64_t(in.u64());
+	instructionCount = in.u64();
+	isRunning = in.boolean();
+	rbTimeout = in.boolean();
+	waiTimeout = in.boolean();
+	quiescent = false;
+
+	updateMode();
+	rbCache = nullptr;
+	flushInstructionCache();
+	updatePageTable();
+}
+
+void Processor::copyMemory(uint8_t * data) const
+{
+	for (unsigned page = 0; page < pageCount; ++page) {
+		std::copy(memory[page].get(), memory[page].get() + pageSize, data + page * pageSize);
+	}
+}
+
+void Processor::setMemory(std::shared_ptr<uint8_t> storage)
+{
+	// Pages get their own reference counts for copy-on-write, each
+	// keeping the whole storage alive.
+	for (unsigned page = 0; page < pageCount; ++page) {
+		memory[page] = std::shared_ptr<uint8_t>(storage.get() + page * pageSize,
+			[storage](uint8_t *) {});
 	}
 
+	flushInstructionCache();
+	updatePageTable();
+}
+
+void Processor::runCompiled()
+{
+	// Blocks are looked up where control flow lands: after taken
+	// branches and jumps, and after a translated block returns.
+	bool blockStart = true;
+
 	while (isRunning
-		&& remainingCycles-- > 0
+		&& remainingCycles > 0
 		&& !waiTimeout
 		&& !rbTimeout)
 	{
-		processInstruction();
+		if (blockStart) {
+			BlockCompiler::Block const * block = jit->lookup(regs.PC);
+
+			// Blocks account their own cycles and instructions and may
+			// chain into further blocks before returning here.
+			if (block != nullptr && remainingCycles >= block->requiredCycles) {
+				jit->execute(*block);
+				continue;
+			}
+		}
+
+		DecodedInstruction const instruction = fetchInstruction();
+		remainingCycles -= instruction.cycles;
+		++instructionCount;
+		regs.PC += instruction.length;
+
+		uint16_t const next = regs.PC;
+		instruction.execute(*this, instruction.operand);
+		blockStart = regs.PC != next;
 	}
 }
 
@@ -117,10 +568,77 @@ void Processor::write(uint8_t address, uint8_t value)
 	writeOnlyMemory(mmu.externalWindow + address, value);
 }
 
+bool Processor::readExternalMemory(uint16_t offset, uint8_t * data, std::size_t size)
+{
+	std::size_t address = mmu.externalWindow + offset;
+	if (!mmu.externalWindowEnabled || address + size > memorySize) {
+		return false;
+	}
+
+	while (size > 0) {
+		uint8_t const page = address / pageSize;
+		std::size_t const start = address % pageSize;
+		std::size_t const length = std::min(size, pageSize - start);
+
+		uint8_t const * ram = ramPages[page].read;
+		if (ram == nullptr) {
+			std::fill(data, data + length, 255);
+		} else {
+			std::copy(ram + start, ram + start + length, data);
+		}
+
+		address += length;
+		data += length;
+		size -= length;
+	}
+
+	return true;
+}
+
+bool Processor::writeExternalMemory(uint16_t offset, uint8_t const * data, std::size_t size)
+{
+	std::size_t address = mmu.externalWindow + offset;
+	if (!mmu.externalWindowEnabled || address + size > memorySize) {
+		return false;
+	}
+
+	while (size > 0) {
+		uint8_t const page = address / pageSize;
+		std::size_t const start = address % pageSize;
+		std::size_t const length = std::min(size, pageSize - start);
+
+		uint8_t * ram = ramPages[page].write;
+		if (ram == nullptr && ramPages[page].read != nullptr) {
+			// Same as writeOnlyMemory() for every byte, but copies the
+			// page once
+			memoryWritten = true;
+			for (std::size_t i = 0; i < length; ++i) {
+				if (tracer) {
+					tracer->recordAccess(Tracer::MemoryWrite, address + i, data[i]);
+				}
+				if (codePages[page]) {
+					invalidateInstructions(address + i);
+				}
+			}
+			ram = writablePage(page);
+		}
+
+		if (ram != nullptr) {
+			std::copy(data, data + length, ram + start);
+		}
+
+		address += length;
+		data += length;
+		size -= length;
+	}
+
+	return true;
+}
+
 void Processor::setFlags(uint8_t mask)
 {
 	bool flagM = getFlag(FlagM);
-	flags = mask | (flags & 0xff00);
+	unpackFlags(mask | (flags & 0xff00));
 
 	if (getFlag(FlagE)) {
 		clearFlag(FlagX);
@@ -139,11 +657,13 @@ void Processor::setFlags(uint8_t mask)
 			}
 		}
 	}
+
+	updateMode();
 }
 
 void Processor::resetFlags(uint8_t mask)
 {
-	uint8_t baseFlags = flags & 0xff;
+	uint8_t baseFlags = packFlags() & 0xff;
 	baseFlags &= ~mask;
 
 	setFlags(baseFlags);
@@ -151,55 +671,103 @@ void Processor::resetFlags(uint8_t mask)
 
 void Processor::setFlag(Flag flag, bool value)
 {
-	if (value) {
-		setFlag(flag);
-	} else {
-		clearFlag(flag);
+	switch (flag) {
+	case Sign:
+		signResult = value ? 0x8000 : 0; break;
+	case Zero:
+		zeroResult = value ? 0 : 1; break;
+	case Carry:
+		carry = value; break;
+	case Overflow:
+		overflow = value; break;
+	default:
+		if (value) {
+			flags |= flag;
+		} else {
+			flags &= ~flag;
+		}
+		break;
 	}
 }
 
 void Processor::setFlag(Flag flag)
 {
-	flags |= flag;
+	setFlag(flag, true);
 }
 
 void Processor::clearFlag(Flag flag)
 {
-	flags &= ~flag;
+	setFlag(flag, false);
 }
 
 bool Processor::getFlag(Flag flag)
 {
-	return flags & flag;
+	switch (flag) {
+	case Sign:
+		return signResult & 0x8000;
+	case Zero:
+		return zeroResult == 0;
+	case Carry:
+		return carry;
+	case Overflow:
+		return overflow;
+	default:
+		return flags & flag;
+	}
+}
+
+uint16_t Processor::packFlags() const
+{
+	return flags
+		| (signResult & 0x8000 ? Sign : 0)
+		| (zeroResult == 0 ? Zero : 0)
+		| (carry ? Carry : 0)
+		| (overflow ? Overflow : 0);
+}
+
+void Processor::unpackFlags(uint16_t value)
+{
+	flags = value & ~(Sign | Zero | Carry | Overflow);
+	signResult = value & Sign ? 0x8000 : 0;
+	zeroResult = value & Zero ? 0 : 1;
+	carry = value & Carry;
+	overflow = value & Overflow;
 }
 
 uint8_t Processor::readOnlyMemory(uint16_t address)
 {
-	if ((address >> 13) + 1u > memoryBanks) {
+	uint8_t const * page = ramPages[address >> 8].read;
+	if (page == nullptr) {
 		return 255;
 	}
 
-	return memory[address];
+	return page[address & 0xff];
 }
 
 uint8_t Processor::readMemory(uint16_t address)
 {
-	if (mmu.redbusEnabled
-		&& (address >= mmu.redbusWindow
-			&& address < (mmu.redbusWindow + 256)))
-	{
-		// std::cout << "Reading from RedBus at " << address << std::endl;
-		if (rbCache == nullptr) {
-			rbCache = RedbusDevice::findDevice(mmu.redbusAddress);
-		}
+	uint8_t const * page = pages[address >> 8].read;
+	if (page != nullptr) {
+		return page[address & 0xff];
+	}
+
+	if (isRedbusAddress(address)) {
 		if (rbCache == nullptr) {
 			std::cout << "Device " << +mmu.redbusAddress << " is not found on Redbus!" << std::endl;
 			rbTimeout = true;
 			return 0;
 		}
 
-		uint8_t tmp = rbCache->read(address - mmu.redbusWindow);
-		// std::cout << "Readed: " << +tmp << std::endl;
+		uint8_t const offset = address - mmu.redbusWindow;
+		uint8_t const * direct = rbMap[offset];
+		uint8_t tmp = direct != nullptr ? *direct : rbCache->read(offset);
+		rbAccessed = true;
+		if (profiler) {
+			profiler->countRedbusRead(mmu.redbusAddress, address - mmu.redbusWindow);
+		}
+		if (tracer) {
+			tracer->recordAccess(Tracer::RedbusRead, address, tmp, mmu.redbusAddress);
+		}
 		return tmp;
 	}
 
@@ -208,223 +776,207 @@ uint8_t Processor::readMemory(uint16_t address)
 
 void Processor::writeOnlyMemory(uint16_t address, uint8_t value)
 {
-	if ((address >> 13) + 1u > memoryBanks) {
+	uint8_t * page = ramPages[address >> 8].write;
+	if (page != nullptr) {
+		page[address & 0xff] = value;
 		return;
 	}
 
-	memory[address] = value;
+	if (ramPages[address >> 8].read == nullptr) {
+		return;
+	}
+
+	// Page holds decoded instructions, is shared with a fork or writes
+	// are being watched
+	memoryWritten = true;
+	if (tracer) {
+		tracer->recordAccess(Tracer::MemoryWrite, address, value);
+	}
+	if (codePages[address >> 8]) {
+		invalidateInstructions(address);
+	}
+	writablePage(address >> 8)[address & 0xff] = value;
 }
 
 void Processor::writeMemory(uint16_t address, uint8_t value)
 {
-	if (mmu.redbusEnabled
-		&& (address >= mmu.redbusWindow
-			&& address < (mmu.redbusWindow + 256)))
-	{
-		// std::cout << "Writing " << +value << " to RedBus at " << address << std::endl;
-		if (rbCache == nullptr) {
-			rbCache = RedbusDevice::findDevice(mmu.redbusAddress);
-		}
+	uint8_t * page = pages[address >> 8].write;
+	if (page != nullptr) {
+		page[address & 0xff] = value;
+		return;
+	}
+
+	if (isRedbusAddress(address)) {
 		if (rbCache == nullptr) {
 			std::cout << "Device " << +mmu.redbusAddress << " is not found on Redbus!" << std::endl;
 			rbTimeout = true;
 			return;
 		}
 
-		rbCache->write(address - mmu.redbusWindow, value);
+		uint8_t const offset = address - mmu.redbusWindow;
+		uint8_t * direct = rbMap[offset];
+		if (direct != nullptr) {
+			*direct = value;
+		} else {
+			rbCache->write(offset, value);
+		}
+		rbAccessed = true;
+		rbWritten = true;
+		if (profiler) {
+			profiler->countRedbusWrite(mmu.redbusAddress, address - mmu.redbusWindow);
+		}
+		if (tracer) {
+			tracer->recordAccess(Tracer::RedbusWrite, address, value, mmu.redbusAddress);
+		}
 	}
 
 	writeOnlyMemory(address, value);
 }
 
-uint8_t Processor::readByte()
-{
-	return readMemory(regs.PC++);
-}
-
-uint16_t Processor::readM()
-{
-	uint16_t i = readByte();
-	if (!getFlag(FlagM)) {
-		i |= readByte() << 8;
-	}
-	return i;
-}
-
-uint16_t Processor::readX()
+template <bool M>
+uint16_t Processor::readM(uint16_t address)
 {
-	uint16_t i = readByte();
-	if (!getFlag(FlagX)) {
-		i |= readByte() << 8;
+	uint16_t i = readMemory(address);
+	if (!M) {
+		i |= readMemory(address + 1) << 8;
 	}
 	return i;
 }
 
-uint16_t Processor::readM(uint16_t address)
+template <bool X>
+uint16_t Processor::readX(uint16_t address)
 {
 	uint16_t i = readMemory(address);
-	if (!getFlag(FlagM)) {
+	if (!X) {
 		i |= readMemory(address + 1) << 8;
 	}
 	return i;
 }
 
-uint16_t Processor::readX(uint16_t address)
+uint16_t Processor::readW(uint16_t address)
 {
 	uint16_t i = readMemory(address);
-	if (!getFlag(FlagX)) {
-		i |= readMemory(address + 1) << 8;
-	}
+	i |= readMemory(address + 1) << 8;
 	return i;
 }
 
+template <bool M>
 void Processor::writeM(uint16_t address, uint16_t value)
 {
 	writeMemory(address, value & 0xff);
-	if (!getFlag(FlagM)) {
+	if (!M) {
 		writeMemory(address + 1, value >> 8);
 	}
 }
 
+template <bool X>
 void Processor::writeX(uint16_t address, uint16_t value)
 {
 	writeMemory(address, value & 0xff);
-	if (!getFlag(FlagX)) {
+	if (!X) {
 		writeMemory(address + 1, value >> 8);
 	}
 }
 
-uint16_t Processor::readBX()
+template <bool X>
+uint16_t Processor::addrBX(uint16_t operand)
 {
-	uint16_t i = readByte() + regs.X;
-	if (getFlag(FlagX)) {
+	uint16_t i = operand + regs.X;
+	if (X) {
 		i &= 0xff;
 	}
 	return i;
 }
 
-uint16_t Processor::readBY()
+template <bool X>
+uint16_t Processor::addrBY(uint16_t operand)
 {
-	uint16_t i = readByte() + regs.Y;
-	if (getFlag(FlagX)) {
+	uint16_t i = operand + regs.Y;
+	if (X) {
 		i &= 0xff;
 	}
 	return i;
 }
 
-uint16_t Processor::readBS()
-{
-	return readByte() + regs.SP;
-}
-
-uint16_t Processor::readBR()
+uint16_t Processor::addrBS(uint16_t operand)
 {
-	return readByte() + regs.R;
+	return operand + regs.SP;
 }
 
-uint16_t Processor::readBSWY()
+uint16_t Processor::addrBR(uint16_t operand)
 {
-	uint16_t i = readByte() + regs.SP;
-	return readW(i) + regs.Y;
+	return operand + regs.R;
 }
 
-uint16_t Processor::readBRWY()
+uint16_t Processor::addrBSWY(uint16_t operand)
 {
-	uint16_t i = readByte() + regs.R;
-	return readW(i) + regs.Y;
+	return readW(operand + regs.SP) + regs.Y;
 }
 
-uint16_t Processor::readW()
+uint16_t Processor::addrBRWY(uint16_t operand)
 {
-	uint16_t i = readByte();
-	i |= readByte() << 8;
-	return i;
-}
-
-uint16_t Processor::readW(uint16_t address)
-{
-	uint16_t i = readMemory(address);
-	i |= readMemory(address + 1) << 8;
-	return i;
+	return readW(operand + regs.R) + regs.Y;
 }
 
-uint16_t Processor::readWX()
+uint16_t Processor::addrWX(uint16_t operand)
 {
-	uint16_t i = readByte();
-	i |= readByte() << 8;
-	return i + regs.X;
+	return operand + regs.X;
 }
 
-uint16_t Processor::readWY()
+uint16_t Processor::addrWY(uint16_t operand)
 {
-	uint16_t i = readByte();
-	i |= readByte() << 8;
-	return i + regs.Y;
+	return operand + regs.Y;
 }
 
-uint16_t Processor::readWXW()
+uint16_t Processor::addrWXW(uint16_t operand)
 {
-	return readW(readWX());
+	return readW(addrWX(operand));
 }
 
-uint16_t Processor::readBW()
+uint16_t Processor::addrBW(uint16_t operand)
 {
-	return readW(readByte());
+	return readW(operand);
 }
 
-uint16_t Processor::readWW()
+uint16_t Processor::addrWW(uint16_t operand)
 {
-	return readW(readW());
+	return readW(operand);
 }
 
-uint16_t Processor::readBXW()
+uint16_t Processor::addrBXW(uint16_t operand)
 {
-	return readW((readByte() + regs.X) & 0xff);
+	return readW((operand + regs.X) & 0xff);
 }
 
-uint16_t Processor::readBWY()
+uint16_t Processor::addrBWY(uint16_t operand)
 {
-	return readW(readByte()) + regs.Y;
+	return readW(operand) + regs.Y;
 }
 
+template <bool M>
 void Processor::updateNZ()
 {
-	updateNZ(regs.A);
+	updateNZ<M>(regs.A);
 }
 
+template <bool M>
 void Processor::updateNZ(uint16_t value)
 {
-	if (value & (getFlag(FlagM) ? 128 : 32768)) {
-		setFlag(Sign);
-	} else {
-		clearFlag(Sign);
-	}
-
-	if (value == 0) {
-		setFlag(Zero);
-	} else {
-		clearFlag(Zero);
-	}
+	signResult = M ? value << 8 : value;
+	zeroResult = value;
 }
 
+template <bool X>
 void Processor::updateNZX(uint16_t value)
 {
-	if (value & (getFlag(FlagX) ? 128 : 32768)) {
-		setFlag(Sign);
-	} else {
-		clearFlag(Sign);
-	}
-
-	if (value == 0) {
-		setFlag(Zero);
-	} else {
-		clearFlag(Zero);
-	}
+	signResult = X ? value << 8 : value;
+	zeroResult = value;
 }
 
+template <bool E>
 void Processor::push1(uint8_t value)
 {
-	if (getFlag(FlagE)) {
+	if (E) {
 		regs.SP = ((regs.SP - 1) & 0xff) | (regs.SP & 0xff00);
 	} else {
 		--regs.SP;
@@ -438,10 +990,11 @@ void Processor::push1r(uint8_t value)
 	writeMemory(--regs.R, value);
 }
 
+template <bool E>
 void Processor::push2(uint16_t value)
 {
-	push1(value >> 8);
-	push1(value);
+	push1<E>(value >> 8);
+	push1<E>(value);
 }
 
 void Processor::push2r(uint16_t value)
@@ -450,46 +1003,51 @@ void Processor::push2r(uint16_t value)
 	push1r(value);
 }
 
+template <bool E, bool M>
 void Processor::pushM(uint16_t value)
 {
-	if (getFlag(FlagM)) {
-		push1(value);
+	if (M) {
+		push1<E>(value);
 	} else {
-		push2(value);
+		push2<E>(value);
 	}
 }
 
+template <bool E, bool X>
 void Processor::pushX(uint16_t value)
 {
-	if (getFlag(FlagX)) {
-		push1(value);
+	if (X) {
+		push1<E>(value);
 	} else {
-		push2(value);
+		push2<E>(value);
 	}
 }
 
+template <bool M>
 void Processor::pushMr(uint16_t value)
 {
-	if (getFlag(FlagM)) {
+	if (M) {
 		push1r(value);
 	} else {
 		push2r(value);
 	}
 }
 
+template <bool X>
 void Processor::pushXr(uint16_t value)
 {
-	if (getFlag(FlagX)) {
+	if (X) {
 		push1r(value);
 	} else {
 		push2r(value);
 	}
 }
 
+template <bool E>
 uint8_t Processor::pop1()
 {
 	uint8_t i = readMemory(regs.SP);
-	if (getFlag(FlagE)) {
+	if (E) {
 		regs.SP = ((regs.SP + 1) & 0xff) | (regs.SP & 0xff00);
 	} else {
 		++regs.SP;
@@ -503,10 +1061,11 @@ uint8_t Processor::pop1r()
 	return readMemory(regs.R++);
 }
 
+template <bool E>
 uint16_t Processor::pop2()
 {
-	uint16_t i = pop1();
-	i |= pop1() << 8;
+	uint16_t i = pop1<E>();
+	i |= pop1<E>() << 8;
 	return i;
 }
 
@@ -517,45 +1076,50 @@ uint16_t Processor::pop2r()
 	return i;
 }
 
+template <bool E, bool M>
 uint16_t Processor::popM()
 {
-	if (getFlag(FlagM)) {
-		return pop1();
+	if (M) {
+		return pop1<E>();
 	}
 
-	return pop2();	
+	return pop2<E>();
 }
 
+template <bool E, bool X>
 uint16_t Processor::popX()
 {
-	if (getFlag(FlagX)) {
-		return pop1();
+	if (X) {
+		return pop1<E>();
 	}
 
-	return pop2();
+	return pop2<E>();
 }
 
+template <bool M>
 uint16_t Processor::popMr()
 {
-	if (getFlag(FlagM)) {
+	if (M) {
 		return pop1r();
 	}
 
 	return pop2r();
 }
 
+template <bool X>
 uint16_t Processor::popXr()
 {
-	if (getFlag(FlagX)) {
+	if (X) {
 		return pop1r();
 	}
 
 	return pop2r();
 }
 
+template <bool M>
 void Processor::i_adc(uint16_t value)
 {
-	if (getFlag(FlagM)) {
+	if (M) {
 		if (getFlag(Decimal)) {
 			// TODO
 			assert(false && "Not implemented");
@@ -571,12 +1135,13 @@ void Processor::i_adc(uint16_t value)
 		regs.A = v & 0xffff;
 	}
 
-	updateNZ();
+	updateNZ<M>();
 }
 
+template <bool M>
 void Processor::i_sbc(uint16_t value)
 {
-	if (getFlag(FlagM)) {
+	if (M) {
 		if (getFlag(Decimal)) {
 			// TODO
 			assert(false && "Not implemented");
@@ -592,12 +1157,13 @@ void Processor::i_sbc(uint16_t value)
 		regs.A = v & 0xffff;
 	}
 
-	updateNZ();
+	updateNZ<M>();
 }
 
+template <bool M>
 void Processor::i_mul(uint16_t value)
 {
-	if (getFlag(FlagM)) {
+	if (M) {
 		assert(false && "Not implemented");
 	} else {
 		int64_t v;
@@ -615,6 +1181,7 @@ void Processor::i_mul(uint16_t value)
 	}
 }
 
+template <bool M>
 void Processor::i_div(uint16_t value)
 {
 	if (value == 0) {
@@ -625,7 +1192,7 @@ void Processor::i_div(uint16_t value)
 		return;
 	}
 
-	if (getFlag(FlagM)) {
+	if (M) {
 		assert(false && "Not implemented");
 	} else if (getFlag(Carry)) {
 		assert(false && "Not implemented");
@@ -641,33 +1208,51 @@ void Processor::i_div(uint16_t value)
 	}
 }
 
+// Translated code calls the 16-bit arithmetic directly
+template void Processor::i_mul<false>(uint16_t value);
+template void Processor::i_div<false>(uint16_t value);
+
+template <bool M>
 void Processor::i_and(uint16_t value)
 {
 	regs.A &= value;
-	updateNZ();
+	updateNZ<M>();
 }
 
+template <bool M>
 void Processor::i_asl(uint16_t value)
 {
-	uint16_t i = readM(value);
+	uint16_t i = readM<M>(value);
 
-	setFlag(Carry, i & (getFlag(FlagM) ? 128 : 32768));
-	i = i << 1 & (getFlag(FlagM) ? 255 : 65535);
-	updateNZ(i);
-	writeM(value, i);
+	setFlag(Carry, i & (M ? 128 : 32768));
+	i = i << 1 & (M ? 255 : 65535);
+	updateNZ<M>(i);
+	writeM<M>(value, i);
 }
 
-void Processor::i_brc(bool condition)
+void Processor::i_brc(bool condition, uint16_t offset)
 {
-	int8_t i = readByte();
 	if (condition) {
-		// std::cout << "Branch to " << +i << std::endl;
-		regs.PC += i;
+		// std::cout << "Branch to " << +int8_t(offset) << std::endl;
+		regs.PC += int8_t(offset);
 	} else {
-		// std::cout << "No branch to " << +i << std::endl;
+		// std::cout << "No branch to " << +int8_t(offset) << std::endl;
 	}
 }
 
+void Processor::i_nxt()
+{
+	regs.PC = readW(regs.I);
+	regs.I += 2;
+}
+
+void Processor::i_ent(uint16_t address)
+{
+	push2r(regs.I);
+	regs.I = regs.PC;
+	regs.PC = address;
+}
+
 void Processor::i_trb(uint16_t value)
 {
 	setFlag(Zero, value & regs.A);
@@ -680,89 +1265,78 @@ void Processor::i_tsb(uint16_t value)
 	regs.A |= value;
 }
 
+template <bool M>
 void Processor::i_cmp(uint16_t x, uint16_t y)
 {
-	if (x >= y) {
-		setFlag(Carry);
-	} else {
-		clearFlag(Carry);
-	}
-
-	if (x == y) {
-		setFlag(Zero);
-	} else {
-		clearFlag(Zero);
-	}
+	carry = x >= y;
 
+	// Zero when x == y
 	x -= y;
-	if (x & (getFlag(FlagM) ? 128 : 32768)) {
-		setFlag(Sign);
-	} else {
-		clearFlag(Sign);
-	}
+	updateNZ<M>(x);
 }
 
+template <bool M>
 void Processor::i_inc(uint16_t address)
 {
-	uint16_t i = readM(address);
-	i = (i + 1) & (getFlag(FlagM) ? 255 : 65535);
-	writeM(address, i);
-	updateNZ(i);
+	uint16_t i = readM<M>(address);
+	i = (i + 1) & (M ? 255 : 65535);
+	writeM<M>(address, i);
+	updateNZ<M>(i);
 }
 
+template <bool M>
 void Processor::i_eor(uint16_t value)
 {
 	regs.A ^= value;
-	updateNZ();
+	updateNZ<M>();
 }
 
+template <bool M>
 void Processor::i_or(uint16_t value)
 {
 	regs.A |= value;
-	updateNZ();
+	updateNZ<M>();
 }
 
 void Processor::processMMU(uint8_t opcode)
 {
-	// std::cout << std::hex << "Got MMU opcode: " << +opcode << std::dec << std::endl;
-
 	switch (opcode) {
 	case 0x00:
 		if (mmu.redbusAddress != (regs.A & 0xff)) {
-			if (rbCache != nullptr) {
+			if (rbAccessed && deviceSwitchYields) {
 				rbTimeout = true;
 			}
 
 			mmu.redbusAddress = (regs.A & 0xff);
+			bindRedbusDevice();
 		}
-		// std::cout << "Redbus window mapped to device " << +mmu.redbusAddress << std::endl;
 		break;
 	case 0x01:
 		mmu.redbusWindow = regs.A;
-		// std::cout << "Redbus window set to " << +mmu.redbusWindow << std::endl;
+		flushInstructionCache();
+		updatePageTable();
 		break;
 	case 0x02:
 		mmu.redbusEnabled = true;
-		// std::cout << "Redbus enabled" << std::endl;
+		flushInstructionCache();
+		updatePageTable();
 		break;
 	case 0x03:
 		mmu.externalWindow = regs.A;
-		// std::cout << "External redbus window set to " << +mmu.externalWindow << std::endl;
 		break;
 	case 0x04:
 		mmu.externalWindowEnabled = true;
-		// std::cout << "Redbus external window enabled" << std::endl;
 		break;
 	case 0x06:
 		porAddress = regs.A;
 		break;
 	case 0x82:
 		mmu.redbusEnabled = false;
-		// std::cout << "Redbus disabled" << std::endl;
+		flushInstructionCache();
+		updatePageTable();
 		break;
 	case 0x84:
 		mmu.externalWindowEnabled = false;
-		// std::cout << "Redbus external window disabled" << std::endl;
 		break;
 	default:
 		std::cout << "Unknown MMU opcode: " << std::hex << +opcode << std::dec << std::endl;
@@ -771,299 +1345,539 @@ void Processor::processMMU(uint8_t opcode)
 	}
 }
 
+void Processor::bindRedbusDevice()
+{
+	rbCache = RedbusDevice::findDevice(mmu.redbusAddress);
+	rbMap = rbCache != nullptr ? rbCache->getMemoryMap().data() : nullptr;
+}
+
 void Processor::processInstruction()
 {
-	uint8_t opcode = readMemory(regs.PC++);
-	// std::cout << std::hex << (regs.PC - 1) << ": Got opcode: " << +opcode << std::dec << " (" << +opcode << ")" << std::endl;
+	DecodedInstruction const instruction = fetchInstruction();
 
-	uint16_t n = 0;
-	switch (opcode) {
-	case 0x01: i_or(readM(readBXW())); break;
-	case 0x02:
-		regs.PC = readW(regs.I);
-		regs.I += 2; break;
-	case 0x03: i_or(readM(readBS())); break;
-	case 0x04: i_tsb(readM(readByte())); break;
-	case 0x05: i_or(readM(readByte())); break;
-	case 0x06: i_asl(readByte()); break;
-	case 0x07: i_or(readM(readBR())); break;
-	case 0x09: i_or(readM()); break;
-	case 0x0b: push2r(regs.I); break;
-	case 0x0c: i_tsb(readM(readW())); break;
-	case 0x0d: i_or(readM(readW())); break;
-	case 0x0e: i_asl(readW()); break;
-	case 0x0f: i_mul(readM(readByte())); break;
-	case 0x10: i_brc(!getFlag(Sign)); break;
-	case 0x11: i_or(readM(readBWY())); break;
-	case 0x12: i_or(readM(readBW())); break;
-	case 0x13: i_or(readM(readBSWY())); break;
-	case 0x14: i_trb(readM(readByte())); break;
-	case 0x15: i_or(readM(readBX())); break;
-	case 0x16: i_asl(readBX()); break;
-	case 0x17: i_or(readM(readBRWY())); break;
-	case 0x18: clearFlag(Carry); break;
-	case 0x19: i_or(readM(readWY())); break;
-	case 0x1a:
-		regs.A = (regs.A + 1) & (getFlag(FlagM) ? 255 : 65535);
-		updateNZ(regs.A); break;
-	case 0x1c: i_trb(readM(readW())); break;
-	case 0x1d: i_or(readM(readWX())); break;
-	case 0x1e: i_asl(readWX()); break;
-	case 0x1f: i_mul(readM(readBX())); break;
-	case 0x21: i_and(readM(readBXW())); break;
-	case 0x22:
-		push2r(regs.I);
-		regs.I = regs.PC + 2;
-		regs.PC = readW(regs.PC); break;
-	case 0x23: i_and(readM(readBS())); break;
-	case 0x25: i_and(readM(readByte())); break;
-	case 0x27: i_and(readM(readBR())); break;
-	case 0x29: i_and(readM()); break;
-	case 0x2a:
-		n = (regs.A << 1 | (getFlag(Carry) ? 1 : 0)) & (getFlag(FlagM) ? 255 : 65535);
-		setFlag(Carry, n & (getFlag(FlagM) ? 128 : 32768));
-		regs.A = n;
-		updateNZ(); break;
-	case 0x2b:
-		regs.I = pop2r();
-		updateNZX(regs.I); break;
-	case 0x2d: i_and(readM(readW())); break;
-	case 0x2f: i_mul(readM(readW())); break;
-	case 0x30: i_brc(getFlag(Sign)); break;
-	case 0x31: i_and(readM(readBWY())); break;
-	case 0x32: i_and(readM(readBW())); break;
-	case 0x33: i_and(readM(readBSWY())); break;
-	case 0x35: i_and(readM(readBX())); break;
-	case 0x37: i_and(readM(readBRWY())); break;
-	case 0x38: setFlag(Carry); break;
-	case 0x39: i_and(readM(readWY())); break;
-	case 0x3a:
-		regs.A = (regs.A - 1) & (getFlag(FlagM) ? 255 : 65535);
-		updateNZ(regs.A); break;
-	case 0x3d: i_and(readM(readWX())); break;
-	case 0x3f: i_mul(readM(readWX())); break;
-	case 0x41: i_eor(readM(readBXW())); break;
-	case 0x42:
-		if (getFlag(FlagM)) {
-			regs.A = readMemory(regs.I++);
+	remainingCycles -= instruction.cycles;
+	++instructionCount;
+	regs.PC += instruction.length;
+	instruction.execute(*this, instruction.operand);
+}
+
+void Processor::runInstrumented()
+{
+	// The interpreter loop, counting and tracing each instruction. NXT
+	// and ENT are run here rather than through threadNext() so that the
+	// words they chain into get seen too.
+	while (isRunning
+		&& remainingCycles > 0
+		&& !waiTimeout
+		&& !rbTimeout)
+	{
+		// Instruction sets change with the mode
+		Handler const nxt = (*instructions)[0x02].execute;
+		Handler const ent = (*instructions)[0x22].execute;
+
+		DecodedInstruction const instruction = fetchInstruction();
+		if (profiler) {
+			profiler->countInstruction(regs.PC, instruction.opcode);
+		}
+		if (tracer) {
+			tracer->recordInstruction(regs.PC, instruction.opcode,
+				regs.A, regs.X, regs.Y, regs.SP, regs.R, regs.I, packFlags());
+		}
+
+		remainingCycles -= instruction.cycles;
+		++instructionCount;
+		regs.PC += instruction.length;
+
+		if (instruction.execute == nxt) {
+			i_nxt();
+		} else if (instruction.execute == ent) {
+			i_ent(instruction.operand);
 		} else {
-			regs.A = readW(regs.I);
-			regs.I += 2;
+			instruction.execute(*this, instruction.operand);
 		}
-		break;
-	case 0x43: i_eor(readM(readBS())); break;
-	case 0x45: i_eor(readM(readByte())); break;
-	case 0x47: i_eor(readM(readBR())); break;
-	case 0x48: pushM(regs.A); break;
-	case 0x49: i_eor(readM()); break;
-	case 0x4b: pushMr(regs.A); break;
-	case 0x4c:
-		regs.PC = readW(); break;
-	case 0x4d: i_eor(readM(readW())); break;
-	case 0x4f: i_div(readM(readByte())); break;
-	case 0x50: i_brc(!getFlag(Overflow)); break;
-	case 0x51: i_eor(readM(readBWY())); break;
-	case 0x52: i_eor(readM(readBW())); break;
-	case 0x53: i_eor(readM(readBSWY())); break;
-	case 0x55: i_eor(readM(readBX())); break;
-	case 0x57: i_eor(readM(readBRWY())); break;
-	case 0x59: i_eor(readM(readWY())); break;
-	case 0x5a: pushX(regs.Y); break;
-	case 0x5c:
-		regs.I = regs.X;
-		updateNZX(regs.X); break;
-	case 0x5d: i_eor(readM(readWX())); break;
-	case 0x5f: i_div(readM(readBX())); break;
-	case 0x60:
-		regs.PC = pop2() + 1; break;
-	case 0x61: i_adc(readM(readBXW())); break;
-	case 0x63: i_adc(readM(readBS())); break;
-	case 0x64: writeM(readByte(), 0); break;
-	case 0x65: i_adc(readM(readByte())); break;
-	case 0x67: i_adc(readM(readBR())); break;
-	case 0x68:
-		regs.A = popM();
-		updateNZ(); break;
-	case 0x69: i_adc(readM()); break;
-	case 0x6a:
-		n = regs.A >> 1 | (getFlag(Carry) ? (getFlag(FlagM) ? 128 : 32768) : 0);
-		setFlag(Carry, regs.A & 0x1);
-		regs.A = n;
-		updateNZ(); break;
-	case 0x6b:
-		regs.A = popMr();
-		updateNZ(regs.A); break;
-	case 0x6d: i_adc(readM(readW())); break;
-	case 0x6f: i_div(readM(readW())); break;
-	case 0x70: i_brc(getFlag(Overflow)); break;
-	case 0x71: i_adc(readM(readBWY())); break;
-	case 0x72: i_adc(readM(readBW())); break;
-	case 0x73: i_adc(readM(readBSWY())); break;
-	case 0x75: i_adc(readM(readBX())); break;
-	case 0x77: i_adc(readM(readBRWY())); break;
-	case 0x79: i_adc(readM(readWY())); break;
-	case 0x7a:
-		regs.Y = popX();
-		updateNZX(regs.Y); break;
-	case 0x7d: i_adc(readM(readWX())); break;
-	case 0x7f: i_div(readM(readWX())); break;
-	case 0x80: i_brc(true); break;
-	case 0x81: writeM(readBXW(), regs.A); break;
-	case 0x83: writeM(readBS(), regs.A); break;
-	case 0x85: writeM(readByte(), regs.A); break;
-	case 0x87: writeM(readBR(), regs.A); break;
-	case 0x88:
-		regs.Y = (regs.Y - 1) & (getFlag(FlagX) ? 255 : 65535);
-		updateNZ(regs.Y); break;
-	case 0x8a:
-		regs.A = regs.X;
-		if (getFlag(FlagM)) {
-			regs.A &= 0xff;
+	}
+}
+
+void Processor::threadNext()
+{
+	Handler const nxt = (*instructions)[0x02].execute;
+	Handler const ent = (*instructions)[0x22].execute;
+
+	// Same conditions as the run loop, which has already charged the
+	// NXT or ENT that got us here.
+	while (!rbTimeout && remainingCycles > 0) {
+		DecodedInstruction const instruction = fetchInstruction();
+		remainingCycles -= instruction.cycles;
+		++instructionCount;
+		regs.PC += instruction.length;
+
+		if (instruction.execute == nxt) {
+			i_nxt();
+		} else if (instruction.execute == ent) {
+			i_ent(instruction.operand);
+		} else {
+			instruction.execute(*this, instruction.operand);
+			return;
 		}
-		updateNZ(); break;
-	case 0x8b:
-		if (getFlag(FlagX)) {
-			regs.SP = (regs.R & 0xff00) | (regs.X & 0xff);
+	}
+}
+
+void Processor::updateMode()
+{
+	mode = (getFlag(FlagE) ? 4 : 0)
+		| (getFlag(FlagM) ? 2 : 0)
+		| (getFlag(FlagX) ? 1 : 0);
+	instructions = &instructionSets[mode];
+}
+
+bool Processor::isRedbusAddress(uint16_t address) const
+{
+	return mmu.redbusEnabled
+		&& address >= mmu.redbusWindow
+		&& address < (mmu.redbusWindow + 256);
+}
+
+Processor::DecodedInstruction Processor::fetchInstruction()
+{
+	auto const & page = decodeCache[regs.PC >> 8];
+	if (page) {
+		DecodedInstruction const & cached = (*page)[regs.PC & 0xff];
+		if (cached.mode == mode) {
+			return cached;
+		}
+	}
+
+	return decodeInstruction(regs.PC);
+}
+
+Processor::DecodedInstruction Processor::decodeInstruction(uint16_t address)
+{
+	uint8_t const opcode = readMemory(address);
+	Instruction const & instruction = (*instructions)[opcode];
+	uint8_t const length = instruction.length;
+
+	uint8_t const cycles = clockMode == ClockMode::Accurate ? instruction.cycles : 1;
+
+	DecodedInstruction decoded{instruction.execute, 0, length, cycles, mode, opcode};
+	if (length > 1) {
+		decoded.operand = readMemory(address + 1);
+	}
+	if (length > 2) {
+		decoded.operand |= readMemory(address + 2) << 8;
+	}
+
+	// Code fetched through the Redbus window has side effects and
+	// has to be read again on every execution.
+	for (uint16_t i = 0; i < length; ++i) {
+		if (isRedbusAddress(address + i)) {
+			return decoded;
+		}
+	}
+
+	auto & page = decodeCache[address >> 8];
+	if (!page) {
+		page.reset(new DecodedPage);
+		page->fill(DecodedInstruction{nullptr, 0, 0, 0, invalidMode, 0});
+	}
+	(*page)[address & 0xff] = decoded;
+
+	for (uint16_t i = 0; i < length; ++i) {
+		watchPage(uint16_t(address + i) >> 8);
+	}
+
+	return decoded;
+}
+
+void Processor::invalidateInstructions(uint16_t address)
+{
+	// Any instruction starting up to maxInstructionLength - 1 bytes
+	// before the address may contain it.
+	for (uint16_t i = 0; i < maxInstructionLength; ++i) {
+		uint16_t const start = address - i;
+
+		auto const & page = decodeCache[start >> 8];
+		if (page) {
+			(*page)[start & 0xff].mode = invalidMode;
+		}
+	}
+
+	if (jit) {
+		jit->invalidate(address);
+	}
+}
+
+void Processor::flushInstructionCache()
+{
+	for (auto & page : decodeCache) {
+		page.reset();
+	}
+	codePages.fill(false);
+
+	if (jit) {
+		jit->flush();
+	}
+}
+
+void Processor::updatePageTable()
+{
+	for (unsigned page = 0; page < pageCount; ++page) {
+		updatePage(page);
+	}
+}
+
+void Processor::updatePage(uint8_t page)
+{
+	unsigned const start = page * pageSize;
+
+	uint8_t * ram = nullptr;
+	if (page * pageSize / bankSize < memoryBanks) {
+		ram = memory[page].get();
+	}
+
+	bool const shared = memory[page].use_count() != 1;
+
+	ramPages[page].read = ram;
+	ramPages[page].write = codePages[page] || shared || watchWrites ? nullptr : ram;
+
+	bool const redbus = mmu.redbusEnabled
+		&& start < mmu.redbusWindow + 256u
+		&& mmu.redbusWindow < start + pageSize;
+
+	pages[page].read = redbus ? nullptr : ramPages[page].read;
+	pages[page].write = redbus ? nullptr : ramPages[page].write;
+}
+
+void Processor::watchPage(uint8_t page)
+{
+	codePages[page] = true;
+	ramPages[page].write = nullptr;
+	pages[page].write = nullptr;
+}
+
+uint8_t * Processor::writablePage(uint8_t page)
+{
+	std::shared_ptr<uint8_t> & storage = memory[page];
+
+	bool const copied = storage.use_count() != 1;
+	if (!copied) {
+		// Forks that shared the page are done reading it
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} else {
+		std::shared_ptr<uint8_t> copy(new uint8_t[pageSize], std::default_delete<uint8_t[]>());
+		std::copy(storage.get(), storage.get() + pageSize, copy.get());
+		storage = std::move(copy);
+	}
+
+	// Writes take the fast path again unless the page holds code. While
+	// writes are watched they stay on the slow path, only a copy moves
+	// the page.
+	if (copied || !watchWrites) {
+		updatePage(page);
+	}
+
+	return storage.get();
+}
+
+void Processor::unknownOpcode(Processor & cpu, uint16_t)
+{
+	uint16_t const address = cpu.regs.PC - 1;
+	std::cout << "Unknown opcode: " << std::hex << +cpu.readOnlyMemory(address) << " at " << address << std::dec << std::endl;
+	cpu.isRunning = false;
+}
+
+template <bool E, bool M, bool X>
+Processor::InstructionSet Processor::buildInstructionSet()
+{
+	// Instruction lengths by operand kind
+	uint8_t const None = 1;
+	uint8_t const Byte = 2;
+	uint8_t const Word = 3;
+	uint8_t const ImmM = M ? 2 : 3;
+	uint8_t const ImmX = X ? 2 : 3;
+
+	InstructionSet set;
+	set.fill(Instruction{&Processor::unknownOpcode, None, 0});
+
+	set[0x01] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBXW(n))); }, Byte};
+	set[0x02] = {[](Processor & p, uint16_t) {
+		p.i_nxt();
+		p.threadNext(); }, None};
+	set[0x03] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBS(n))); }, Byte};
+	set[0x04] = {[](Processor & p, uint16_t n) { p.i_tsb(p.readM<M>(n)); }, Byte};
+	set[0x05] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(n)); }, Byte};
+	set[0x06] = {[](Processor & p, uint16_t n) { p.i_asl<M>(n); }, Byte};
+	set[0x07] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBR(n))); }, Byte};
+	set[0x09] = {[](Processor & p, uint16_t n) { p.i_or<M>(n); }, ImmM};
+	set[0x0b] = {[](Processor & p, uint16_t) { p.push2r(p.regs.I); }, None};
+	set[0x0c] = {[](Processor & p, uint16_t n) { p.i_tsb(p.readM<M>(n)); }, Word};
+	set[0x0d] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(n)); }, Word};
+	set[0x0e] = {[](Processor & p, uint16_t n) { p.i_asl<M>(n); }, Word};
+	set[0x0f] = {[](Processor & p, uint16_t n) { p.i_mul<M>(p.readM<M>(n)); }, Byte};
+	set[0x10] = {[](Processor & p, uint16_t n) { p.i_brc(!p.getFlag(Sign), n); }, Byte};
+	set[0x11] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBWY(n))); }, Byte};
+	set[0x12] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBW(n))); }, Byte};
+	set[0x13] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBSWY(n))); }, Byte};
+	set[0x14] = {[](Processor & p, uint16_t n) { p.i_trb(p.readM<M>(n)); }, Byte};
+	set[0x15] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0x16] = {[](Processor & p, uint16_t n) { p.i_asl<M>(p.addrBX<X>(n)); }, Byte};
+	set[0x17] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrBRWY(n))); }, Byte};
+	set[0x18] = {[](Processor & p, uint16_t) { p.clearFlag(Carry); }, None};
+	set[0x19] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrWY(n))); }, Word};
+	set[0x1a] = {[](Processor & p, uint16_t) {
+		p.regs.A = (p.regs.A + 1) & (M ? 255 : 65535);
+		p.updateNZ<M>(p.regs.A); }, None};
+	set[0x1c] = {[](Processor & p, uint16_t n) { p.i_trb(p.readM<M>(n)); }, Word};
+	set[0x1d] = {[](Processor & p, uint16_t n) { p.i_or<M>(p.readM<M>(p.addrWX(n))); }, Word};
+	set[0x1e] = {[](Processor & p, uint16_t n) { p.i_asl<M>(p.addrWX(n)); }, Word};
+	set[0x1f] = {[](Processor & p, uint16_t n) { p.i_mul<M>(p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0x21] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBXW(n))); }, Byte};
+	set[0x22] = {[](Processor & p, uint16_t n) {
+		p.i_ent(n);
+		p.threadNext(); }, Word};
+	set[0x23] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBS(n))); }, Byte};
+	set[0x25] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(n)); }, Byte};
+	set[0x27] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBR(n))); }, Byte};
+	set[0x29] = {[](Processor & p, uint16_t n) { p.i_and<M>(n); }, ImmM};
+	set[0x2a] = {[](Processor & p, uint16_t) {
+		uint16_t n = (p.regs.A << 1 | (p.getFlag(Carry) ? 1 : 0)) & (M ? 255 : 65535);
+		p.setFlag(Carry, n & (M ? 128 : 32768));
+		p.regs.A = n;
+		p.updateNZ<M>(); }, None};
+	set[0x2b] = {[](Processor & p, uint16_t) {
+		p.regs.I = p.pop2r();
+		p.updateNZX<X>(p.regs.I); }, None};
+	set[0x2d] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(n)); }, Word};
+	set[0x2f] = {[](Processor & p, uint16_t n) { p.i_mul<M>(p.readM<M>(n)); }, Word};
+	set[0x30] = {[](Processor & p, uint16_t n) { p.i_brc(p.getFlag(Sign), n); }, Byte};
+	set[0x31] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBWY(n))); }, Byte};
+	set[0x32] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBW(n))); }, Byte};
+	set[0x33] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBSWY(n))); }, Byte};
+	set[0x35] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0x37] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrBRWY(n))); }, Byte};
+	set[0x38] = {[](Processor & p, uint16_t) { p.setFlag(Carry); }, None};
+	set[0x39] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrWY(n))); }, Word};
+	set[0x3a] = {[](Processor & p, uint16_t) {
+		p.regs.A = (p.regs.A - 1) & (M ? 255 : 65535);
+		p.updateNZ<M>(p.regs.A); }, None};
+	set[0x3d] = {[](Processor & p, uint16_t n) { p.i_and<M>(p.readM<M>(p.addrWX(n))); }, Word};
+	set[0x3f] = {[](Processor & p, uint16_t n) { p.i_mul<M>(p.readM<M>(p.addrWX(n))); }, Word};
+	set[0x41] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBXW(n))); }, Byte};
+	set[0x42] = {[](Processor & p, uint16_t) {
+		if (M) {
+			p.regs.A = p.readMemory(p.regs.I++);
 		} else {
-			regs.R = regs.X;
+			p.regs.A = p.readW(p.regs.I);
+			p.regs.I += 2;
+		} }, None};
+	set[0x43] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBS(n))); }, Byte};
+	set[0x45] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(n)); }, Byte};
+	set[0x47] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBR(n))); }, Byte};
+	set[0x48] = {[](Processor & p, uint16_t) { p.pushM<E, M>(p.regs.A); }, None};
+	set[0x49] = {[](Processor & p, uint16_t n) { p.i_eor<M>(n); }, ImmM};
+	set[0x4b] = {[](Processor & p, uint16_t) { p.pushMr<M>(p.regs.A); }, None};
+	set[0x4c] = {[](Processor & p, uint16_t n) { p.regs.PC = n; }, Word};
+	set[0x4d] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(n)); }, Word};
+	set[0x4f] = {[](Processor & p, uint16_t n) { p.i_div<M>(p.readM<M>(n)); }, Byte};
+	set[0x50] = {[](Processor & p, uint16_t n) { p.i_brc(!p.getFlag(Overflow), n); }, Byte};
+	set[0x51] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBWY(n))); }, Byte};
+	set[0x52] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBW(n))); }, Byte};
+	set[0x53] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBSWY(n))); }, Byte};
+	set[0x55] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0x57] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrBRWY(n))); }, Byte};
+	set[0x59] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrWY(n))); }, Word};
+	set[0x5a] = {[](Processor & p, uint16_t) { p.pushX<E, X>(p.regs.Y); }, None};
+	set[0x5c] = {[](Processor & p, uint16_t) {
+		p.regs.I = p.regs.X;
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0x5d] = {[](Processor & p, uint16_t n) { p.i_eor<M>(p.readM<M>(p.addrWX(n))); }, Word};
+	set[0x5f] = {[](Processor & p, uint16_t n) { p.i_div<M>(p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0x60] = {[](Processor & p, uint16_t) { p.regs.PC = p.pop2<E>() + 1; }, None};
+	set[0x61] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBXW(n))); }, Byte};
+	set[0x63] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBS(n))); }, Byte};
+	set[0x64] = {[](Processor & p, uint16_t n) { p.writeM<M>(n, 0); }, Byte};
+	set[0x65] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(n)); }, Byte};
+	set[0x67] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBR(n))); }, Byte};
+	set[0x68] = {[](Processor & p, uint16_t) {
+		p.regs.A = p.popM<E, M>();
+		p.updateNZ<M>(); }, None};
+	set[0x69] = {[](Processor & p, uint16_t n) { p.i_adc<M>(n); }, ImmM};
+	set[0x6a] = {[](Processor & p, uint16_t) {
+		uint16_t n = p.regs.A >> 1 | (p.getFlag(Carry) ? (M ? 128 : 32768) : 0);
+		p.setFlag(Carry, p.regs.A & 0x1);
+		p.regs.A = n;
+		p.updateNZ<M>(); }, None};
+	set[0x6b] = {[](Processor & p, uint16_t) {
+		p.regs.A = p.popMr<M>();
+		p.updateNZ<M>(p.regs.A); }, None};
+	set[0x6d] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(n)); }, Word};
+	set[0x6f] = {[](Processor & p, uint16_t n) { p.i_div<M>(p.readM<M>(n)); }, Word};
+	set[0x70] = {[](Processor & p, uint16_t n) { p.i_brc(p.getFlag(Overflow), n); }, Byte};
+	set[0x71] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBWY(n))); }, Byte};
+	set[0x72] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBW(n))); }, Byte};
+	set[0x73] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBSWY(n))); }, Byte};
+	set[0x75] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0x77] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrBRWY(n))); }, Byte};
+	set[0x79] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrWY(n))); }, Word};
+	set[0x7a] = {[](Processor & p, uint16_t) {
+		p.regs.Y = p.popX<E, X>();
+		p.updateNZX<X>(p.regs.Y); }, None};
+	set[0x7d] = {[](Processor & p, uint16_t n) { p.i_adc<M>(p.readM<M>(p.addrWX(n))); }, Word};
+	set[0x7f] = {[](Processor & p, uint16_t n) { p.i_div<M>(p.readM<M>(p.addrWX(n))); }, Word};
+	set[0x80] = {[](Processor & p, uint16_t n) { p.i_brc(true, n); }, Byte};
+	set[0x81] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBXW(n), p.regs.A); }, Byte};
+	set[0x83] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBS(n), p.regs.A); }, Byte};
+	set[0x85] = {[](Processor & p, uint16_t n) { p.writeM<M>(n, p.regs.A); }, Byte};
+	set[0x87] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBR(n), p.regs.A); }, Byte};
+	set[0x88] = {[](Processor & p, uint16_t) {
+		p.regs.Y = (p.regs.Y - 1) & (X ? 255 : 65535);
+		p.updateNZ<M>(p.regs.Y); }, None};
+	set[0x8a] = {[](Processor & p, uint16_t) {
+		p.regs.A = p.regs.X;
+		if (M) {
+			p.regs.A &= 0xff;
 		}
-		updateNZX(regs.R); break;
-	case 0x8d: writeM(readW(), regs.A); break;
-	case 0x8f:
-		regs.D = regs.B = 0; break;
-	case 0x90: i_brc(!getFlag(Carry)); break;
-	case 0x91: writeM(readBWY(), regs.A); break;
-	case 0x92: writeM(readBW(), regs.A); break;
-	case 0x93: writeM(readBSWY(), regs.A); break;
-	case 0x95: writeM(readBX(), regs.A); break;
-	case 0x97: writeM(readBRWY(), regs.A); break;
-	case 0x99: writeM(readWY(), regs.A); break;
-	case 0x9a:
-		if (getFlag(FlagX)) {
-			regs.SP = (regs.SP & 0xff00) | (regs.X & 0xff);
+		p.updateNZ<M>(); }, None};
+	set[0x8b] = {[](Processor & p, uint16_t) {
+		if (X) {
+			p.regs.SP = (p.regs.R & 0xff00) | (p.regs.X & 0xff);
 		} else {
-			regs.SP = regs.X;
+			p.regs.R = p.regs.X;
 		}
-		updateNZX(regs.X); break;
-	case 0x9d: writeM(readWX(), regs.A); break;
-	case 0xa0:
-		regs.Y = readX();
-		updateNZ(regs.Y); break;
-	case 0xa1:
-		regs.A = readM(readBXW());
-		updateNZ(); break;
-	case 0xa2:
-		regs.X = readX();
-		updateNZ(regs.X); break;
-	case 0xa3:
-		regs.A = readM(readBS());
-		updateNZ(); break;
-	case 0xa5:
-		regs.A = readM(readByte());
-		updateNZ(); break;
-	case 0xa8:
-		regs.Y = regs.A;
-		if (getFlag(FlagX)) {
-			regs.Y &= 0xff;
+		p.updateNZX<X>(p.regs.R); }, None};
+	set[0x8d] = {[](Processor & p, uint16_t n) { p.writeM<M>(n, p.regs.A); }, Word};
+	set[0x8f] = {[](Processor & p, uint16_t) { p.regs.D = p.regs.B = 0; }, None};
+	set[0x90] = {[](Processor & p, uint16_t n) { p.i_brc(!p.getFlag(Carry), n); }, Byte};
+	set[0x91] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBWY(n), p.regs.A); }, Byte};
+	set[0x92] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBW(n), p.regs.A); }, Byte};
+	set[0x93] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBSWY(n), p.regs.A); }, Byte};
+	set[0x95] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBX<X>(n), p.regs.A); }, Byte};
+	set[0x97] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrBRWY(n), p.regs.A); }, Byte};
+	set[0x99] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrWY(n), p.regs.A); }, Word};
+	set[0x9a] = {[](Processor & p, uint16_t) {
+		if (X) {
+			p.regs.SP = (p.regs.SP & 0xff00) | (p.regs.X & 0xff);
+		} else {
+			p.regs.SP = p.regs.X;
 		}
-		updateNZX(regs.Y); break;
-	case 0xa9:
-		regs.A = readM();
-		updateNZ(); break;
-	case 0xaa:
-		regs.X = regs.A;
-		if (getFlag(FlagX)) {
-			regs.X &= 0xff;
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0x9d] = {[](Processor & p, uint16_t n) { p.writeM<M>(p.addrWX(n), p.regs.A); }, Word};
+	set[0xa0] = {[](Processor & p, uint16_t n) {
+		p.regs.Y = n;
+		p.updateNZ<M>(p.regs.Y); }, ImmX};
+	set[0xa1] = {[](Processor & p, uint16_t n) {
+		p.regs.A = p.readM<M>(p.addrBXW(n));
+		p.updateNZ<M>(); }, Byte};
+	set[0xa2] = {[](Processor & p, uint16_t n) {
+		p.regs.X = n;
+		p.updateNZ<M>(p.regs.X); }, ImmX};
+	set[0xa3] = {[](Processor & p, uint16_t n) {
+		p.regs.A = p.readM<M>(p.addrBS(n));
+		p.updateNZ<M>(); }, Byte};
+	set[0xa5] = {[](Processor & p, uint16_t n) {
+		p.regs.A = p.readM<M>(n);
+		p.updateNZ<M>(); }, Byte};
+	set[0xa8] = {[](Processor & p, uint16_t) {
+		p.regs.Y = p.regs.A;
+		if (X) {
+			p.regs.Y &= 0xff;
 		}
-		updateNZX(regs.X); break;
-	case 0xad:
-		regs.A = readM(readW());
-		updateNZ(); break;
-	case 0xb0: i_brc(getFlag(Carry)); break;
-	case 0xb5:
-		regs.A = readM(readBX());
-		updateNZ(); break;
-	case 0xba:
-		regs.X = regs.SP;
-		if (getFlag(FlagX)) {
-			regs.X &= 0xff;
+		p.updateNZX<X>(p.regs.Y); }, None};
+	set[0xa9] = {[](Processor & p, uint16_t n) {
+		p.regs.A = n;
+		p.updateNZ<M>(); }, ImmM};
+	set[0xaa] = {[](Processor & p, uint16_t) {
+		p.regs.X = p.regs.A;
+		if (X) {
+			p.regs.X &= 0xff;
 		}
-		updateNZX(regs.X); break;
-	case 0xbb:
-		regs.X = regs.Y;
-		updateNZX(regs.X); break;
-	case 0xc1: i_cmp(regs.A, readM(readBXW())); break;
-	case 0xc2: resetFlags(readByte()); break;
-	case 0xc3: i_cmp(regs.A, readM(readBS())); break;
-	case 0xc5: i_cmp(regs.A, readM(readByte())); break;
-	case 0xc7: i_cmp(regs.A, readM(readBR())); break;
-	case 0xc9: i_cmp(regs.A, readM()); break;
-	case 0xca:
-		regs.X = (regs.X - 1) & (getFlag(FlagX) ? 255 : 65535);
-		updateNZ(regs.X); break;
-	case 0xcb:
-		waiTimeout = true; break;
-	case 0xcd: i_cmp(regs.A, readM(readW())); break;
-	case 0xcf:
-		regs.D = popM(); break;
-	case 0xd0: i_brc(!getFlag(Zero)); break;
-	case 0xd1: i_cmp(regs.A, readM(readBWY())); break;
-	case 0xd2: i_cmp(regs.A, readM(readBW())); break;
-	case 0xd3: i_cmp(regs.A, readM(readBSWY())); break;
-	case 0xd5: i_cmp(regs.A, readM(readBX())); break;
-	case 0xd7: i_cmp(regs.A, readM(readBRWY())); break;
-	case 0xd9: i_cmp(regs.A, readM(readWY())); break;
-	case 0xda: pushX(regs.X); break;
-	case 0xdc:
-		regs.X = regs.I;
-		if (getFlag(FlagX)) {
-			regs.X &= 0xff;
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0xad] = {[](Processor & p, uint16_t n) {
+		p.regs.A = p.readM<M>(n);
+		p.updateNZ<M>(); }, Word};
+	set[0xb0] = {[](Processor & p, uint16_t n) { p.i_brc(p.getFlag(Carry), n); }, Byte};
+	set[0xb5] = {[](Processor & p, uint16_t n) {
+		p.regs.A = p.readM<M>(p.addrBX<X>(n));
+		p.updateNZ<M>(); }, Byte};
+	set[0xba] = {[](Processor & p, uint16_t) {
+		p.regs.X = p.regs.SP;
+		if (X) {
+			p.regs.X &= 0xff;
 		}
-		updateNZX(regs.X); break;
-	case 0xdd: i_cmp(regs.A, readM(readWX())); break;
-	case 0xdf: pushM(regs.D); break;
-	case 0xe2: setFlags(readByte()); break;
-	case 0xe3: i_sbc(readM(readBS())); break;
-	case 0xe6: i_inc(readByte()); break;
-	case 0xe8:
-		regs.X = (regs.X + 1) & (getFlag(FlagX) ? 255 : 65535);
-		updateNZ(regs.X); break;
-	case 0xee: i_inc(readW()); break;
-	case 0xef: processMMU(readByte()); break;
-	case 0xf0: i_brc(getFlag(Zero)); break;
-	case 0xf4: push2(readW()); break;
-	case 0xf6: i_inc(readBX()); break;
-	case 0xfa:
-		regs.X = popX();
-		updateNZX(regs.X); break;
-	case 0xfb:
-		if (getFlag(FlagE) == getFlag(Carry)) {
-			break;
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0xbb] = {[](Processor & p, uint16_t) {
+		p.regs.X = p.regs.Y;
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0xc1] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBXW(n))); }, Byte};
+	set[0xc2] = {[](Processor & p, uint16_t n) { p.resetFlags(n); }, Byte};
+	set[0xc3] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBS(n))); }, Byte};
+	set[0xc5] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(n)); }, Byte};
+	set[0xc7] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBR(n))); }, Byte};
+	set[0xc9] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, n); }, ImmM};
+	set[0xca] = {[](Processor & p, uint16_t) {
+		p.regs.X = (p.regs.X - 1) & (X ? 255 : 65535);
+		p.updateNZ<M>(p.regs.X); }, None};
+	set[0xcb] = {[](Processor & p, uint16_t) { p.waiTimeout = true; }, None};
+	set[0xcd] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(n)); }, Word};
+	set[0xcf] = {[](Processor & p, uint16_t) { p.regs.D = p.popM<E, M>(); }, None};
+	set[0xd0] = {[](Processor & p, uint16_t n) { p.i_brc(!p.getFlag(Zero), n); }, Byte};
+	set[0xd1] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBWY(n))); }, Byte};
+	set[0xd2] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBW(n))); }, Byte};
+	set[0xd3] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBSWY(n))); }, Byte};
+	set[0xd5] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBX<X>(n))); }, Byte};
+	set[0xd7] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrBRWY(n))); }, Byte};
+	set[0xd9] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrWY(n))); }, Word};
+	set[0xda] = {[](Processor & p, uint16_t) { p.pushX<E, X>(p.regs.X); }, None};
+	set[0xdc] = {[](Processor & p, uint16_t) {
+		p.regs.X = p.regs.I;
+		if (X) {
+			p.regs.X &= 0xff;
+		}
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0xdd] = {[](Processor & p, uint16_t n) { p.i_cmp<M>(p.regs.A, p.readM<M>(p.addrWX(n))); }, Word};
+	set[0xdf] = {[](Processor & p, uint16_t) { p.pushM<E, M>(p.regs.D); }, None};
+	set[0xe2] = {[](Processor & p, uint16_t n) { p.setFlags(n); }, Byte};
+	set[0xe3] = {[](Processor & p, uint16_t n) { p.i_sbc<M>(p.readM<M>(p.addrBS(n))); }, Byte};
+	set[0xe6] = {[](Processor & p, uint16_t n) { p.i_inc<M>(n); }, Byte};
+	set[0xe8] = {[](Processor & p, uint16_t) {
+		p.regs.X = (p.regs.X + 1) & (X ? 255 : 65535);
+		p.updateNZ<M>(p.regs.X); }, None};
+	set[0xee] = {[](Processor & p, uint16_t n) { p.i_inc<M>(n); }, Word};
+	set[0xef] = {[](Processor & p, uint16_t n) { p.processMMU(n); }, Byte};
+	set[0xf0] = {[](Processor & p, uint16_t n) { p.i_brc(p.getFlag(Zero), n); }, Byte};
+	set[0xf4] = {[](Processor & p, uint16_t n) { p.push2<E>(n); }, Word};
+	set[0xf6] = {[](Processor & p, uint16_t n) { p.i_inc<M>(p.addrBX<X>(n)); }, Byte};
+	set[0xfa] = {[](Processor & p, uint16_t) {
+		p.regs.X = p.popX<E, X>();
+		p.updateNZX<X>(p.regs.X); }, None};
+	set[0xfb] = {[](Processor & p, uint16_t) {
+		if (E == p.getFlag(Carry)) {
+			return;
 		}
 
-		if (getFlag(FlagE)) {
-			clearFlag(FlagE);
-			setFlag(Carry);
+		if (E) {
+			p.clearFlag(FlagE);
+			p.setFlag(Carry);
 		} else {
-			setFlag(FlagE);
-			clearFlag(Carry);
-			if (!getFlag(FlagM)) {
-				regs.B = regs.A >> 8;
+			p.setFlag(FlagE);
+			p.clearFlag(Carry);
+			if (!M) {
+				p.regs.B = p.regs.A >> 8;
 			}
-			setFlag(FlagM);
-			setFlag(FlagX);
-			regs.A &= 0xff;
-			regs.Y &= 0xff;
-			regs.X &= 0xff;
+			p.setFlag(FlagM);
+			p.setFlag(FlagX);
+			p.regs.A &= 0xff;
+			p.regs.Y &= 0xff;
+			p.regs.X &= 0xff;
 		}
 
-		break;
-	case 0xfe: i_inc(readWX()); break;
-	default:
-		std::cout << "Unknown opcode: " << std::hex << +opcode << " at " << regs.PC-1 << std::dec << std::endl;
-		isRunning = false;
-		break;
+		p.updateMode(); }, None};
+	set[0xfe] = {[](Processor & p, uint16_t n) { p.i_inc<M>(p.addrWX(n)); }, Word};
+
+	for (unsigned opcode = 0; opcode < set.size(); ++opcode) {
+		set[opcode].cycles = cycleCost(opcode, M, X);
 	}
+
+	return set;
 }
 
 void Processor::loadBootImage()
@@ -1071,7 +1885,8 @@ void Processor::loadBootImage()
 	try {
 		auto bootImage = loadFile(bootImagePath);
 		for (unsigned i = 0; i < bootImageSize && i < bootImage.size(); ++i) {
-			memory[bootImageOffset + i] = bootImage[i];
+			unsigned const address = bootImageOffset + i;
+			writablePage(address / pageSize)[address % pageSize] = bootImage[i];
 		}
 	} catch (std::runtime_error & e) {
 		std::cout << e.what() << std::endl;
@@ -2,14 +2,44 @@
 
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
 
 #include "RedbusDevice.h"
 #include "RedbusNetwork.h"
 
+class BlockCompiler;
+class Profiler;
+class StateReader;
+class StateWriter;
+class Tracer;
+
 class Processor : public RedbusDevice
 {
 public:
 	Processor(RedbusNetwork & network, unsigned memoryBanks, uint8_t address);
+	// Forks a copy of parent onto network. Memory pages are shared
+	// copy-on-write, each side copies a page when it first writes it.
+	Processor(RedbusNetwork & network, Processor & parent);
+	~Processor();
+
+	// Switches between the interpreter and translated x86-64 blocks,
+	// returns false if the host has no JIT support.
+	bool setJitEnabled(bool enabled);
+
+	// Counts every executed instruction and Redbus access, see Profiler.
+	// Profiled ticks always run interpreted. A disabled profiler costs a
+	// check per tick and per Redbus access.
+	void setProfiling(bool enabled);
+	// Null unless profiling
+	Profiler * getProfiler() const;
+
+	// Records the last capacity instructions, memory writes and Redbus
+	// accesses, see Tracer. Traced ticks run interpreted with every write
+	// on the slow path. Zero disables tracing.
+	void setTracing(std::size_t capacity);
+	// Null unless tracing
+	Tracer * getTracer() const;
 
 	void coldBoot();
 	void warmBoot();
@@ -17,9 +47,60 @@ public:
 
 	void runTick();
 
+	// Instructions executed since the processor was created
+	uint64_t getInstructionCount() const;
+	// Calls to runTick() since the processor was created
+	uint32_t getTicks() const;
+	bool isHalted() const;
+	// True when the last tick ended on WAI, waiting for an interrupt
+	bool isWaiting() const;
+	// True when the last tick ended on WAI without writing to a Redbus
+	// device, like a guest polling an empty keyboard buffer
+	bool isIdle() const;
+	// True when the last tick left the registers, memory and devices as
+	// they were, so further ticks change nothing until a device gets
+	// input. Memory writes are only tracked in the tick following an
+	// idle one, quiescence takes two idle ticks to show.
+	bool isQuiescent() const;
+
+	// Fast mode charges one cycle per instruction, accurate mode charges
+	// each instruction its cost for the current register widths.
+	enum class ClockMode {
+		Fast,
+		Accurate
+	};
+
+	void setClock(unsigned cyclesPerTick, ClockMode clockMode);
+
+	// Mapping another Redbus device after accessing one ends the tick
+	// unless disabled, which lets guest code alternating between devices
+	// carry on within the tick.
+	void setDeviceSwitchYields(bool yields);
+	bool getDeviceSwitchYields() const;
+	unsigned getCyclesPerTick() const;
+	ClockMode getClockMode() const;
+
+	static unsigned const defaultCyclesPerTick;
+
+	// Snapshot support. The memory is saved and restored on its own so
+	// that it can be mapped from the snapshot file.
+	static unsigned const memorySize = 64 * 1024;
+
+	void saveState(StateWriter & out) const;
+	void loadState(StateReader & in);
+
+	void copyMemory(uint8_t * data) const;
+	// Replaces the memory with memorySize bytes kept alive by storage
+	void setMemory(std::shared_ptr<uint8_t> storage);
+
 	uint8_t read(uint8_t address) override;
 	void write(uint8_t address, uint8_t value) override;
+	// The external memory window, which extends past 256 bytes here
+	bool readExternalMemory(uint16_t offset, uint8_t * data, std::size_t size) override;
+	bool writeExternalMemory(uint16_t offset, uint8_t const * data, std::size_t size) override;
 private:
+	friend class BlockCompiler;
+
 	enum Flag {
 		Carry		= 1 << 0,
 		Zero		= 1 << 1,
@@ -38,91 +119,149 @@ private:
 	void setFlag(Flag flag);
 	void clearFlag(Flag flag);
 	bool getFlag(Flag flag);
+	// The whole status register, E in bit 8
+	uint16_t packFlags() const;
+	void unpackFlags(uint16_t value);
 
 	uint8_t readOnlyMemory(uint16_t address);
 	uint8_t readMemory(uint16_t address);
 	void writeOnlyMemory(uint16_t address, uint8_t value);
 	void writeMemory(uint16_t address, uint8_t value);
 
-	uint8_t readByte();
-	uint16_t readM();
-	uint16_t readX();
-	uint16_t readM(uint16_t address);
-	uint16_t readX(uint16_t address);
-
-	void writeM(uint16_t address, uint16_t value);
-	void writeX(uint16_t address, uint16_t value);
-
-	uint16_t readBX();
-	uint16_t readBY();
-	uint16_t readBS();
-	uint16_t readBR();
-	uint16_t readBSWY();
-	uint16_t readBRWY();
-	uint16_t readW();
+	// Mode dependent helpers are instantiated per E/M/X flag value,
+	// see buildInstructionSet().
+	template <bool M> uint16_t readM(uint16_t address);
+	template <bool X> uint16_t readX(uint16_t address);
 	uint16_t readW(uint16_t address);
-	uint16_t readWX();
-	uint16_t readWY();
-	uint16_t readWXW();
-	uint16_t readBW();
-	uint16_t readWW();
-	uint16_t readBXW();
-	uint16_t readBWY();
-
-	void updateNZ();
-	void updateNZ(uint16_t value);
-	void updateNZX(uint16_t value);
-
-	void push1(uint8_t value);
+
+	template <bool M> void writeM(uint16_t address, uint16_t value);
+	template <bool X> void writeX(uint16_t address, uint16_t value);
+
+	// Effective addresses computed from an already fetched operand
+	template <bool X> uint16_t addrBX(uint16_t operand);
+	template <bool X> uint16_t addrBY(uint16_t operand);
+	uint16_t addrBS(uint16_t operand);
+	uint16_t addrBR(uint16_t operand);
+	uint16_t addrBSWY(uint16_t operand);
+	uint16_t addrBRWY(uint16_t operand);
+	uint16_t addrWX(uint16_t operand);
+	uint16_t addrWY(uint16_t operand);
+	uint16_t addrWXW(uint16_t operand);
+	uint16_t addrBW(uint16_t operand);
+	uint16_t addrWW(uint16_t operand);
+	uint16_t addrBXW(uint16_t operand);
+	uint16_t addrBWY(uint16_t operand);
+
+	template <bool M> void updateNZ();
+	template <bool M> void updateNZ(uint16_t value);
+	template <bool X> void updateNZX(uint16_t value);
+
+	template <bool E> void push1(uint8_t value);
 	void push1r(uint8_t value);
-	void push2(uint16_t value);
+	template <bool E> void push2(uint16_t value);
 	void push2r(uint16_t value);
-	void pushM(uint16_t value);
-	void pushX(uint16_t value);
-	void pushMr(uint16_t value);
-	void pushXr(uint16_t value);
+	template <bool E, bool M> void pushM(uint16_t value);
+	template <bool E, bool X> void pushX(uint16_t value);
+	template <bool M> void pushMr(uint16_t value);
+	template <bool X> void pushXr(uint16_t value);
 
-	uint8_t pop1();
+	template <bool E> uint8_t pop1();
 	uint8_t pop1r();
-	uint16_t pop2();
+	template <bool E> uint16_t pop2();
 	uint16_t pop2r();
-	uint16_t popM();
-	uint16_t popX();
-	uint16_t popMr();
-	uint16_t popXr();
-
-	void i_adc(uint16_t value);
-	void i_sbc(uint16_t value);
-	void i_mul(uint16_t value);
-	void i_div(uint16_t value);
-	void i_and(uint16_t value);
-	void i_asl(uint16_t value);
-	void i_brc(bool condition);
+	template <bool E, bool M> uint16_t popM();
+	template <bool E, bool X> uint16_t popX();
+	template <bool M> uint16_t popMr();
+	template <bool X> uint16_t popXr();
+
+	template <bool M> void i_adc(uint16_t value);
+	template <bool M> void i_sbc(uint16_t value);
+	template <bool M> void i_mul(uint16_t value);
+	template <bool M> void i_div(uint16_t value);
+	template <bool M> void i_and(uint16_t value);
+	template <bool M> void i_asl(uint16_t value);
+	void i_brc(bool condition, uint16_t offset);
+	void i_nxt();
+	void i_ent(uint16_t address);
 	void i_trb(uint16_t value);
 	void i_tsb(uint16_t value);
-	void i_cmp(uint16_t x, uint16_t y);
-	void i_inc(uint16_t address);
-	void i_eor(uint16_t value);
-	void i_or(uint16_t value);
+	template <bool M> void i_cmp(uint16_t x, uint16_t y);
+	template <bool M> void i_inc(uint16_t address);
+	template <bool M> void i_eor(uint16_t value);
+	template <bool M> void i_or(uint16_t value);
 
 	void processMMU(uint8_t opcode);
+	void bindRedbusDevice();
 	void processInstruction();
+	void runCompiled();
+	void runInstrumented();
+
+	// Forth inner interpreter fast path, see NXT and ENT
+	void threadNext();
+
+	// Instruction handlers receive the pre-extracted operand, regs.PC
+	// already points to the next instruction.
+	typedef void (*Handler)(Processor & cpu, uint16_t operand);
+
+	struct Instruction {
+		Handler execute;
+		uint8_t length;
+		// Filled in from the cost tables once the set is built
+		uint8_t cycles = 0;
+	};
+
+	struct DecodedInstruction {
+		Handler execute;
+		uint16_t operand;
+		uint8_t length;
+		uint8_t cycles;
+		uint8_t mode;
+		uint8_t opcode;
+	};
+
+	typedef std::array<Instruction, 256> InstructionSet;
+	typedef std::array<DecodedInstruction, 256> DecodedPage;
+
+	template <bool E, bool M, bool X>
+	static InstructionSet buildInstructionSet();
+	static void unknownOpcode(Processor & cpu, uint16_t operand);
+
+	void updateMode();
+	bool isRedbusAddress(uint16_t address) const;
+	DecodedInstruction fetchInstruction();
+	DecodedInstruction decodeInstruction(uint16_t address);
+	void invalidateInstructions(uint16_t address);
+	void flushInstructionCache();
+
+	void updatePageTable();
+	void updatePage(uint8_t page);
+	void watchPage(uint8_t page);
+	// Copies a page shared with a fork before it is written
+	uint8_t * writablePage(uint8_t page);
 
 	void loadBootImage();
 
 	static unsigned const bankSize = 8 * 1024;
 	static unsigned const maxBankCount = 8;
-	static unsigned const memorySize = maxBankCount * bankSize;
+	static_assert(memorySize == maxBankCount * bankSize, "Memory must hold every bank");
 	static unsigned const bootImageOffset;
 	static unsigned const bootImageSize;
-	static unsigned const cyclesPerTick;
+	static unsigned const pageSize = 256;
+	static unsigned const pageCount = memorySize / pageSize;
+	static unsigned const maxInstructionLength = 3;
+	static uint8_t const invalidMode = 0xff;
+
+	// Indexed by mode
+	static std::array<InstructionSet, 8> const instructionSets;
 
 	static std::string const bootImagePath;
 
-	std::array<uint8_t, memorySize> memory;
+	// Memory by page, on the heap or in a private mapping of a snapshot.
+	// Pages are shared with forks until written.
+	std::array<std::shared_ptr<uint8_t>, pageCount> memory;
 	unsigned memoryBanks;
 
-	struct {
+	struct Registers {
 		uint16_t A;
 		uint8_t B;
 		uint16_t X;
@@ -134,7 +273,7 @@ private:
 		uint16_t I;
 	} regs;
 
-	struct {
+	struct Mmu {
 		uint8_t redbusAddress;
 		uint16_t redbusWindow;
 		uint16_t externalWindow;
@@ -142,16 +281,68 @@ private:
 		bool externalWindowEnabled;
 	} mmu;
 
+	// Sign, Zero, Carry and Overflow live outside flags so that ALU
+	// instructions update them with plain stores instead of read-modify-
+	// writes: Sign is bit 15 of signResult, Zero is set when zeroResult
+	// is 0. Their bits in flags stay clear, packFlags() puts them back.
 	uint16_t flags;
+	uint16_t signResult;
+	uint16_t zeroResult;
+	bool carry;
+	bool overflow;
+	// E/M/X flags packed as E << 2 | M << 1 | X, selects the active
+	// instruction set and tags decoded instructions
+	uint8_t mode;
+	InstructionSet const * instructions;
 
 	uint16_t brkAddress;
 	uint16_t porAddress;
 
 	uint32_t ticks;
-	unsigned remainingCycles;
+	long remainingCycles;
+	uint64_t instructionCount;
+	unsigned cyclesPerTick;
+	ClockMode clockMode;
 	bool isRunning;
 	bool rbTimeout;
 	bool waiTimeout;
+	bool rbWritten;
 
+	// Set by the slow write path. While watchWrites is on every write
+	// takes it, see isQuiescent().
+	bool watchWrites;
+	bool memoryWritten;
+	bool quiescent;
+
+	// The device mapped at mmu.redbusAddress, bound at the start of
+	// every tick and when mapping another device. rbAccessed is set once
+	// the tick accessed it.
 	RedbusDevice * rbCache;
+	// Its directly mapped memory by window offset, null without device
+	uint8_t * const * rbMap;
+	bool rbAccessed;
+	bool deviceSwitchYields;
+
+	// Decoded instructions by address, allocated a page at a time.
+	// codePages marks every page holding a byte of a cached instruction.
+	std::array<std::unique_ptr<DecodedPage>, pageCount> decodeCache;
+	std::array<bool, pageCount> codePages;
+
+	// Host pointers into memory per page. A null entry sends the access
+	// down the slow path: unmapped banks, pages overlapping the Redbus
+	// window and, for writes, pages watched for decoded instructions or
+	// shared with a fork, and every page while watchWrites is on.
+	// pages is the CPU view, ramPages the plain RAM view used by the
+	// external window. Rebuilt by updatePageTable() on remapping.
+	struct PageEntry {
+		uint8_t * read;
+		uint8_t * write;
+	};
+
+	std::array<PageEntry, pageCount> pages;
+	std::array<PageEntry, pageCount> ramPages;
+
+	std::unique_ptr<BlockCompiler> jit;
+	std::unique_ptr<Profiler> profiler;
+	std::unique_ptr<Tracer> tracer;
 };
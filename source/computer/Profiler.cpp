@@ -0,0 +1,190 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+#include "common/FileUtil.h"
+#include "common/StateStream.h"
+
+namespace {
+
+// Addressing mode by opcode, '-' for unimplemented opcodes:
+// i implied, # immediate, b relative, a absolute, X/Y absolute indexed,
+// d direct, x direct,X, n (direct), p (direct,X), q (direct),Y,
+// s stack relative, t (stack),Y, r R-stack relative, u (R-stack),Y
+char const addressingModes[] =
+//	 0123456789abcdef
+	"-pisdddr-#-iaaad" // 0x
+	"bqntdxxuiYi-aXXx" // 1x
+	"-pas-d-r-#ii-a-a" // 2x
+	"bqnt-x-uiYi--X-X" // 3x
+	"-pis-d-ri#-iaa-d" // 4x
+	"bqnt-x-u-Yi-iX-x" // 5x
+	"ip-sdd-ri#ii-a-a" // 6x
+	"bqnt-x-u-Yi--X-X" // 7x
+	"bp-s-d-ri-ii-a-i" // 8x
+	"bqnt-x-u-Yi--X--" // 9x
+	"#p#s-d--i#i--a--" // ax
+	"b----x----ii----" // bx
+	"-p#s-d-r-#ii-a-i" // cx
+	"bqnt-x-u-Yi-iX-i" // dx
+	"--#s--d-i-----a#" // ex
+	"b---a-x---ii--X-"; // fx
+
+char const * modeName(char mode)
+{
+	switch (mode) {
+	case 'i': return "implied";
+	case '#': return "#imm";
+	case 'b': return "rel";
+	case 'a': return "abs";
+	case 'X': return "abs,X";
+	case 'Y': return "abs,Y";
+	case 'd': return "dir";
+	case 'x': return "dir,X";
+	case 'n': return "(dir)";
+	case 'p': return "(dir,X)";
+	case 'q': return "(dir),Y";
+	case 's': return "off,S";
+	case 't': return "(off,S),Y";
+	case 'r': return "off,R";
+	case 'u': return "(off,R),Y";
+	default: return "unknown";
+	}
+}
+
+// Indices of the non-zero counts, highest count first
+std::vector<unsigned> ranked(std::vector<uint64_t> const & counts)
+{
+	std::vector<unsigned> indices;
+	for (unsigned i = 0; i < counts.size(); ++i) {
+		if (counts[i] != 0) {
+			indices.push_back(i);
+		}
+	}
+
+	std::stable_sort(indices.begin(), indices.end(),
+		[&counts](unsigned a, unsigned b) { return counts[a] > counts[b]; });
+	return indices;
+}
+
+std::string hex(unsigned value, int width)
+{
+	std::ostringstream out;
+	out << std::hex << std::setfill('0') << std::setw(width) << value;
+	return out.str();
+}
+
+double percent(uint64_t count, uint64_t total)
+{
+	return total != 0 ? 100.0 * count / total : 0;
+}
+
+uint64_t sum(std::vector<uint64_t> const & counts)
+{
+	return std::accumulate(counts.begin(), counts.end(), uint64_t(0));
+}
+
+unsigned const reportedAddresses = 32;
+
+char const histogramMagic[8] = {'E', 'F', 'P', 'C', 'P', 'R', 'O', 'F'};
+uint32_t const histogramVersion = 1;
+
+}
+
+Profiler::Profiler() :
+	addressCounts(64 * 1024),
+	opcodeCounts(),
+	redbusReads(256 * 256),
+	redbusWrites(256 * 256)
+{}
+
+void Profiler::reset()
+{
+	std::fill(addressCounts.begin(), addressCounts.end(), 0);
+	opcodeCounts.fill(0);
+	std::fill(redbusReads.begin(), redbusReads.end(), 0);
+	std::fill(redbusWrites.begin(), redbusWrites.end(), 0);
+}
+
+void Profiler::writeReport(std::ostream & out) const
+{
+	uint64_t const instructions = sum(addressCounts);
+
+	std::vector<uint64_t> const opcodes(opcodeCounts.begin(), opcodeCounts.end());
+	std::vector<uint64_t> modes(256);
+	for (unsigned opcode = 0; opcode < 256; ++opcode) {
+		modes[uint8_t(addressingModes[opcode])] += opcodeCounts[opcode];
+	}
+
+	std::vector<uint64_t> redbus(redbusReads.size());
+	for (unsigned i = 0; i < redbus.size(); ++i) {
+		redbus[i] = redbusReads[i] + redbusWrites[i];
+	}
+
+	out << std::fixed << std::setprecision(2)
+		<< "Instructions: " << instructions
+		<< ", Redbus reads: " << sum(redbusReads)
+		<< ", Redbus writes: " << sum(redbusWrites) << "\n";
+
+	out << "\nHottest addresses\n";
+	std::vector<unsigned> const addresses = ranked(addressCounts);
+	for (unsigned i = 0; i < addresses.size() && i < reportedAddresses; ++i) {
+		uint64_t const count = addressCounts[addresses[i]];
+		out << "  " << hex(addresses[i], 4)
+			<< std::setw(16) << count
+			<< std::setw(8) << percent(count, instructions) << "%\n";
+	}
+
+	out << "\nOpcodes\n";
+	for (unsigned opcode : ranked(opcodes)) {
+		out << "  " << hex(opcode, 2)
+			<< "  " << std::left << std::setw(10) << modeName(addressingModes[opcode]) << std::right
+			<< std::setw(16) << opcodes[opcode]
+			<< std::setw(8) << percent(opcodes[opcode], instructions) << "%\n";
+	}
+
+	out << "\nAddressing modes\n";
+	for (unsigned mode : ranked(modes)) {
+		out << "  " << std::left << std::setw(14) << modeName(char(mode)) << std::right
+			<< std::setw(16) << modes[mode]
+			<< std::setw(8) << percent(modes[mode], instructions) << "%\n";
+	}
+
+	out << "\nRedbus accesses\n"
+		<< "  Device  Offset           Reads          Writes\n";
+	for (unsigned index : ranked(redbus)) {
+		out << "      " << hex(index >> 8, 2)
+			<< "      " << hex(index & 0xff, 2)
+			<< std::setw(16) << redbusReads[index]
+			<< std::setw(16) << redbusWrites[index] << "\n";
+	}
+
+	out << std::flush;
+}
+
+void Profiler::writeHistogram(std::string const & filename) const
+{
+	StateWriter out;
+	for (char c : histogramMagic) {
+		out.u8(c);
+	}
+	out.u32(histogramVersion);
+
+	for (uint64_t count : addressCounts) {
+		out.u64(count);
+	}
+	for (uint64_t count : opcodeCounts) {
+		out.u64(count);
+	}
+	for (uint64_t count : redbusReads) {
+		out.u64(count);
+	}
+	for (uint64_t count : redbusWrites) {
+		out.u64(count);
+	}
+
+	saveFile(filename, out.getData());
+}
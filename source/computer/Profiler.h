@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Exact execution counts of a processor: instructions by address and by
+// opcode, and Redbus accesses by device and offset. Counting costs two
+// increments per instruction, cheap enough to leave on during real
+// workloads. See Processor::setProfiling().
+class Profiler
+{
+public:
+	Profiler();
+
+	void countInstruction(uint16_t address, uint8_t opcode)
+	{
+		++addressCounts[address];
+		++opcodeCounts[opcode];
+	}
+
+	void countRedbusRead(uint8_t device, uint8_t offset)
+	{
+		++redbusReads[device << 8 | offset];
+	}
+
+	void countRedbusWrite(uint8_t device, uint8_t offset)
+	{
+		++redbusWrites[device << 8 | offset];
+	}
+
+	void reset();
+
+	// Human readable summary, hottest first
+	void writeReport(std::ostream & out) const;
+	// Raw counters, see docs/profiler.md
+	void writeHistogram(std::string const & filename) const;
+private:
+	std::vector<uint64_t> addressCounts;
+	std::array<uint64_t, 256> opcodeCounts;
+	// By device << 8 | offset
+	std::vector<uint64_t> redbusReads;
+	std::vector<uint64_t> redbusWrites;
+};
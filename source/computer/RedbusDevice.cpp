@@ -11,3 +11,25 @@ RedbusDevice::~RedbusDevice()
 {
 	network.removeDevice(this);
 }
+
+void RedbusDevice::setAddress(uint8_t address)
+{
+	uint8_t const oldAddress = this->address;
+	this->address = address;
+	network.moveDevice(this, oldAddress);
+}
+
+RedbusDevice::MemoryMap const & RedbusDevice::getMemoryMap()
+{
+	if (!memoryMapped) {
+		remapMemory();
+	}
+	return memoryMap;
+}
+
+void RedbusDevice::remapMemory()
+{
+	memoryMap.fill(nullptr);
+	mapMemory(memoryMap);
+	memoryMapped = true;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
 #include "RedbusNetwork.h"
@@ -11,14 +13,46 @@ public:
 	~RedbusDevice();
 
 	uint8_t getAddress() const { return address; };
-	void setAddress(uint8_t address) { this->address = address; };
+	void setAddress(uint8_t address);
 
 	RedbusDevice * findDevice(uint8_t address) { return network.findDevice(address); };
 
 	virtual uint8_t read(uint8_t address) = 0;
 	virtual void write(uint8_t address, uint8_t value) = 0;
+
+	// Block transfers for other devices, to memory the device exposes
+	// through an external window, at offsets from the window start.
+	// Return false if the device has no window or the range does not fit.
+	virtual bool readExternalMemory(uint16_t offset, uint8_t * data, std::size_t size)
+	{
+		(void)offset; (void)data; (void)size;
+		return false;
+	};
+	virtual bool writeExternalMemory(uint16_t offset, uint8_t const * data, std::size_t size)
+	{
+		(void)offset; (void)data; (void)size;
+		return false;
+	};
+
+	typedef std::array<uint8_t *, 256> MemoryMap;
+
+	// Points the entries of map, indexed by address like read() and
+	// write(), at device memory the processor may access directly
+	// instead of calling them. Only plain memory can be mapped, entries
+	// left null go through read() and write().
+	virtual void mapMemory(MemoryMap & map) { (void)map; };
+	// Built on first use, stays at the same place for the lifetime of
+	// the device
+	MemoryMap const & getMemoryMap();
+protected:
+	// Call from write(), or between ticks, once mapMemory() would map
+	// different memory
+	void remapMemory();
 private:
 	RedbusNetwork & network;
 
 	uint8_t address;
+
+	MemoryMap memoryMap;
+	bool memoryMapped = false;
 };
@@ -2,14 +2,23 @@
 
 #include "RedbusDevice.h"
 
-RedbusDevice * RedbusNetwork::findDevice(uint8_t address)
+void RedbusNetwork::registerDevice(RedbusDevice * device)
 {
-	auto const end = devices.end();
-	for (auto it = devices.begin(); it != end; ++it) {
-		if ((*it)->getAddress() == address) {
-			return *it;
-		}
+	devices[device->getAddress()] = device;
+}
+
+void RedbusNetwork::removeDevice(RedbusDevice * device)
+{
+	RedbusDevice * & slot = devices[device->getAddress()];
+	if (slot == device) {
+		slot = nullptr;
 	}
+}
 
-	return nullptr;
+void RedbusNetwork::moveDevice(RedbusDevice * device, uint8_t oldAddress)
+{
+	if (devices[oldAddress] == device) {
+		devices[oldAddress] = nullptr;
+	}
+	registerDevice(device);
 }
@@ -1,19 +1,23 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
-#include <set>
 
 class RedbusDevice;
 
+// Devices by Redbus address, one per address. A device registering at
+// an address already taken replaces the previous one.
 class RedbusNetwork
 {
 public:
 	RedbusNetwork() = default;
 
-	void registerDevice(RedbusDevice * device) { devices.insert(device); };
-	void removeDevice(RedbusDevice * device) { devices.erase(device); };
+	void registerDevice(RedbusDevice * device);
+	void removeDevice(RedbusDevice * device);
+	// Called by a device changing its address from oldAddress
+	void moveDevice(RedbusDevice * device, uint8_t oldAddress);
 
-	RedbusDevice * findDevice(uint8_t address);
+	RedbusDevice * findDevice(uint8_t address) const { return devices[address]; };
 private:
-	std::set<RedbusDevice *> devices;
+	std::array<RedbusDevice *, 256> devices{};
 };
@@ -0,0 +1,95 @@
+#include "Tracer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "common/FileUtil.h"
+#include "common/StateStream.h"
+
+namespace {
+
+char const traceMagic[8] = {'E', 'F', 'P', 'C', 'T', 'R', 'C', 'E'};
+uint32_t const traceVersion = 1;
+uint32_t const recordSize = 18;
+
+}
+
+Tracer::Tracer(std::size_t capacity) :
+	records(),
+	mask(0),
+	total(0)
+{
+	std::size_t size = 1;
+	while (size < capacity) {
+		size *= 2;
+	}
+
+	records.resize(size);
+	mask = size - 1;
+}
+
+void Tracer::save(std::string const & filename) const
+{
+	uint64_t const count = std::min<uint64_t>(total, records.size());
+
+	StateWriter out;
+	for (char c : traceMagic) {
+		out.u8(c);
+	}
+	out.u32(traceVersion);
+	out.u32(recordSize);
+	out.u64(count);
+	out.u64(total);
+
+	for (uint64_t n = total - count; n < total; ++n) {
+		Record const & record = records[n & mask];
+		out.u8(record.type);
+		out.u8(record.value);
+		out.u16(record.address);
+		out.u16(record.a);
+		out.u16(record.x);
+		out.u16(record.y);
+		out.u16(record.sp);
+		out.u16(record.r);
+		out.u16(record.i);
+		out.u16(record.flags);
+	}
+
+	saveFile(filename, out.getData());
+}
+
+std::vector<Tracer::Record> Tracer::load(std::string const & filename, uint64_t & total)
+{
+	std::vector<uint8_t> const data = loadFile(filename);
+	StateReader in(data.data(), data.size());
+
+	uint8_t magic[sizeof(traceMagic)];
+	in.bytes(magic, sizeof(magic));
+	if (!std::equal(magic, magic + sizeof(magic), reinterpret_cast<uint8_t const *>(traceMagic))) {
+		throw std::runtime_error("Not a trace file");
+	}
+	if (in.u32() != traceVersion || in.u32() != recordSize) {
+		throw std::runtime_error("Unsupported trace version");
+	}
+
+	uint64_t const count = in.u64();
+	total = in.u64();
+
+	std::vector<Record> loaded;
+	for (uint64_t n = 0; n < count; ++n) {
+		Record record;
+		record.type = Type(in.u8());
+		record.value = in.u8();
+		record.address = in.u16();
+		record.a = in.u16();
+		record.x = in.u16();
+		record.y = in.u16();
+		record.sp = in.u16();
+		record.r = in.u16();
+		record.i = in.u16();
+		record.flags = in.u16();
+		loaded.push_back(record);
+	}
+
+	return loaded;
+}
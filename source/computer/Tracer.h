@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Records the last executed instructions with their register state, and
+// the memory writes and Redbus accesses they made, in a preallocated
+// ring. Older records are overwritten. See Processor::setTracing() and
+// docs/trace.md for the file format.
+class Tracer
+{
+public:
+	enum Type : uint8_t {
+		Instruction,
+		MemoryWrite,
+		RedbusRead,
+		RedbusWrite
+	};
+
+	struct Record {
+		Type type;
+		// Opcode, or the byte written or read
+		uint8_t value;
+		// PC, or the address accessed
+		uint16_t address;
+		// Registers before the instruction. Redbus accesses keep the
+		// device address in a, memory writes leave them zero.
+		uint16_t a;
+		uint16_t x;
+		uint16_t y;
+		uint16_t sp;
+		uint16_t r;
+		uint16_t i;
+		uint16_t flags;
+	};
+
+	// Capacity is rounded up to a power of two
+	explicit Tracer(std::size_t capacity);
+
+	void recordInstruction(uint16_t pc, uint8_t opcode,
+		uint16_t a, uint16_t x, uint16_t y, uint16_t sp, uint16_t r, uint16_t i,
+		uint16_t flags)
+	{
+		records[total++ & mask] = Record{Instruction, opcode, pc, a, x, y, sp, r, i, flags};
+	}
+
+	void recordAccess(Type type, uint16_t address, uint8_t value, uint8_t device = 0)
+	{
+		records[total++ & mask] = Record{type, value, address, device, 0, 0, 0, 0, 0, 0};
+	}
+
+	// Records made since the tracer was created, including overwritten ones
+	uint64_t getTotal() const { return total; };
+
+	// Writes the records still in the ring, oldest first
+	void save(std::string const & filename) const;
+	// Reads a file written by save(), total is set to getTotal() at the
+	// time it was saved
+	static std::vector<Record> load(std::string const & filename, uint64_t & total);
+private:
+	std::vector<Record> records;
+	std::size_t mask;
+	uint64_t total;
+};
@@ -0,0 +1,131 @@
+#include "BatchRunner.h"
+
+#include "Context.h"
+#include "InputLog.h"
+
+BatchRunner::BatchRunner(Context & context, std::vector<uint8_t> input, Limits const & limits) :
+	context(context),
+	input(std::move(input)),
+	inputPosition(0),
+	replay(nullptr),
+	replayPosition(0),
+	recorder(nullptr),
+	limits(limits),
+	startInstructions(0),
+	ticks(0),
+	stopReason(nullptr)
+{}
+
+void BatchRunner::setReplay(InputLog const & log)
+{
+	replay = &log;
+}
+
+void BatchRunner::setRecorder(InputLog & log)
+{
+	recorder = &log;
+}
+
+void BatchRunner::start()
+{
+	// A restored processor carries on where it was saved
+	if (context.processor.isHalted()) {
+		context.processor.warmBoot();
+	}
+
+	startInstructions = context.processor.getInstructionCount();
+
+	if (replay != nullptr && !(InputLog::now(context.processor) == replay->getStart())) {
+		stopReason = "replay starts from a different state";
+	}
+	if (recorder != nullptr) {
+		recorder->begin(context.processor);
+	}
+}
+
+bool BatchRunner::runTicks(unsigned tickCount)
+{
+	for (unsigned i = 0; i < tickCount && !isStopped(); ++i) {
+		if (replay != nullptr) {
+			replayInput();
+			if (isStopped()) {
+				break;
+			}
+		} else {
+			typeInput();
+		}
+
+		context.processor.runTick();
+		++ticks;
+
+		checkLimits();
+	}
+
+	return !isStopped();
+}
+
+uint64_t BatchRunner::getInstructions() const
+{
+	return context.processor.getInstructionCount() - startInstructions;
+}
+
+void BatchRunner::typeInput()
+{
+	while (inputPosition < input.size() && !context.console.isKeyBufferFull()) {
+		uint8_t code = input[inputPosition++];
+		if (code == 10) {
+			code = 13;
+		}
+		if (code > 0 && code <= 127) {
+			context.console.pushKey(code);
+			if (recorder != nullptr) {
+				recorder->record(context.processor, code);
+			}
+		}
+	}
+}
+
+void BatchRunner::replayInput()
+{
+	Processor const & processor = context.processor;
+	auto const & events = replay->getEvents();
+
+	for (; replayPosition < events.size(); ++replayPosition) {
+		InputLog::Event const & event = events[replayPosition];
+		if (event.stamp.tick > processor.getTicks()) {
+			break;
+		}
+		if (!(event.stamp == InputLog::now(processor))) {
+			stopReason = "replay diverged";
+			return;
+		}
+
+		context.console.pushKey(event.key);
+		if (recorder != nullptr) {
+			recorder->record(processor, event.key);
+		}
+	}
+}
+
+void BatchRunner::checkLimits()
+{
+	Processor const & processor = context.processor;
+
+	if (processor.isHalted()) {
+		stopReason = "halted";
+	} else if (replay != nullptr && processor.getTicks() >= replay->getEnd().tick) {
+		bool const same = InputLog::now(processor) == replay->getEnd()
+			&& replayPosition == replay->getEvents().size();
+		stopReason = same ? "replay finished" : "replay diverged";
+	} else if (limits.maxInstructions != 0 && getInstructions() >= limits.maxInstructions) {
+		stopReason = "instruction budget reached";
+	} else if (limits.deadline != Clock::time_point::max() && Clock::now() >= limits.deadline) {
+		stopReason = "time limit reached";
+	} else if (((limits.stopOnIdle && processor.isIdle())
+			|| (limits.stopOnQuiescence && processor.isQuiescent()))
+		&& inputPosition == input.size()
+		&& !context.console.hasPendingKeys())
+	{
+		stopReason = "idle";
+	}
+}
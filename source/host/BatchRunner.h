@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct Context;
+class InputLog;
+
+// Runs a machine unthrottled, typing an input script on its keyboard as
+// fast as the guest consumes it, until a stop condition hits. A halted
+// processor always stops the run.
+class BatchRunner
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Limits {
+		// Zero for no budget
+		uint64_t maxInstructions = 0;
+		Clock::time_point deadline = Clock::time_point::max();
+		// Stop once the input is consumed and the guest idles on WAI
+		bool stopOnIdle = false;
+		// Stop once the input is consumed and further ticks would change
+		// nothing, for machines nothing else can type on
+		bool stopOnQuiescence = false;
+	};
+
+	BatchRunner(Context & context, std::vector<uint8_t> input, Limits const & limits);
+
+	// Types the keys of a log at the ticks they were recorded at
+	// instead of the input, and stops at the end of the log or as soon
+	// as the run departs from it. Call before start().
+	void setReplay(InputLog const & log);
+	// Records every key typed, from start() on
+	void setRecorder(InputLog & log);
+
+	// Warm boots the processor unless it is already running
+	void start();
+
+	// Runs up to tickCount ticks, returns false once the run stopped
+	bool runTicks(unsigned tickCount);
+
+	bool isStopped() const { return stopReason != nullptr; };
+	char const * getStopReason() const { return stopReason; };
+
+	uint64_t getInstructions() const;
+	unsigned long getTicks() const { return ticks; };
+private:
+	void typeInput();
+	void replayInput();
+	void checkLimits();
+
+	Context & context;
+
+	std::vector<uint8_t> input;
+	std::size_t inputPosition;
+
+	InputLog const * replay;
+	std::size_t replayPosition;
+	InputLog * recorder;
+
+	Limits limits;
+
+	uint64_t startInstructions;
+	unsigned long ticks;
+	char const * stopReason;
+};
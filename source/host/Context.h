@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "computer/Console.h"
+#include "computer/FloppyDrive.h"
+#include "computer/Processor.h"
+#include "computer/RedbusNetwork.h"
+
+// Redbus addresses and memory of a standard machine
+constexpr uint8_t consoleAddress     = 0x01;
+constexpr uint8_t floppyDriveAddress = 0x02;
+constexpr uint8_t processorAddress   = 0x00;
+constexpr uint8_t memoryBankCount    = 8;
+
+// One complete machine: a processor, a console and a floppy drive on
+// their own Redbus network.
+struct Context {
+public:
+	RedbusNetwork net;
+
+	Console console;
+	FloppyDrive drive;
+	Processor processor;
+
+	Context(uint8_t consoleAdr, uint8_t driveAdr, uint8_t cpuAdr,
+			uint8_t bankCount) :
+		console(net, consoleAdr),
+		drive(net, driveAdr),
+		processor(net, bankCount, cpuAdr)
+	{}
+
+	// Clones the machine. Memory pages and disk sectors stay shared
+	// copy-on-write, so a fork only pays for what it writes. Only the
+	// thread running this machine may fork it.
+	std::unique_ptr<Context> fork()
+	{
+		return std::unique_ptr<Context>(new Context(*this));
+	}
+private:
+	Context(Context & parent) :
+		console(net, parent.console),
+		drive(net, parent.drive),
+		processor(net, parent.processor)
+	{}
+};
@@ -0,0 +1,104 @@
+#include "Host.h"
+
+#include <cassert>
+#include <iomanip>
+
+namespace {
+
+double toSeconds(BatchRunner::Clock::duration duration)
+{
+	return std::chrono::duration<double>(duration).count();
+}
+
+double toMips(uint64_t instructions, double seconds)
+{
+	return seconds > 0 ? instructions / seconds / 1e6 : 0;
+}
+
+}
+
+Host::Host(unsigned threadCount, unsigned ticksPerQuantum) :
+	scheduler(threadCount),
+	ticksPerQuantum(ticksPerQuantum),
+	machines(),
+	elapsed()
+{
+	assert(ticksPerQuantum != 0);
+}
+
+Context & Host::addMachine(std::vector<uint8_t> input, BatchRunner::Limits const & limits)
+{
+	std::unique_ptr<Context> context(new Context(consoleAddress, floppyDriveAddress, processorAddress, memoryBankCount));
+	return add(std::move(context), std::move(input), limits);
+}
+
+Context & Host::forkMachine(Context & parent, std::vector<uint8_t> input, BatchRunner::Limits const & limits)
+{
+	return add(parent.fork(), std::move(input), limits);
+}
+
+Context & Host::add(std::unique_ptr<Context> context, std::vector<uint8_t> input, BatchRunner::Limits const & limits)
+{
+	// The input is all a machine ever gets, one that is done with it
+	// and waits for more would be scheduled forever
+	BatchRunner::Limits machineLimits = limits;
+	machineLimits.stopOnQuiescence = true;
+	std::unique_ptr<BatchRunner> runner(new BatchRunner(*context, std::move(input), machineLimits));
+
+	machines.push_back(Machine{std::move(context), std::move(runner), {}});
+	return *machines.back().context;
+}
+
+void Host::run()
+{
+	for (auto & machine : machines) {
+		machine.runner->start();
+	}
+
+	BatchRunner::Clock::time_point const start = BatchRunner::Clock::now();
+	scheduler.run(machines.size(), [this](unsigned machine) { return runQuantum(machine); });
+	elapsed = BatchRunner::Clock::now() - start;
+}
+
+bool Host::runQuantum(unsigned index)
+{
+	Machine & machine = machines[index];
+
+	BatchRunner::Clock::time_point const start = BatchRunner::Clock::now();
+	bool const running = machine.runner->runTicks(ticksPerQuantum);
+	machine.busy += BatchRunner::Clock::now() - start;
+
+	return running;
+}
+
+void Host::printReport(std::ostream & out) const
+{
+	uint64_t totalInstructions = 0;
+
+	out << std::fixed << std::setprecision(2)
+		<< "  VM  Instructions   Ticks   Busy ms     MIPS  Stopped\n";
+
+	for (unsigned i = 0; i < machines.size(); ++i) {
+		Machine const & machine = machines[i];
+		uint64_t const instructions = machine.runner->getInstructions();
+		double const busy = toSeconds(machine.busy);
+
+		out << std::setw(4) << i
+			<< std::setw(14) << instructions
+			<< std::setw(8) << machine.runner->getTicks()
+			<< std::setw(10) << busy * 1000
+			<< std::setw(9) << toMips(instructions, busy)
+			<< "  " << machine.runner->getStopReason() << "\n";
+
+		totalInstructions += instructions;
+	}
+
+	double const seconds = toSeconds(elapsed);
+
+	out << "Machines: " << machines.size()
+		<< ", threads: " << scheduler.getWorkerCount()
+		<< ", steals: " << scheduler.getSteals() << "\n"
+		<< "Instructions: " << totalInstructions << "\n"
+		<< "Time: " << seconds * 1000 << " ms\n"
+		<< "Aggregate MIPS: " << toMips(totalInstructions, seconds) << std::endl;
+}
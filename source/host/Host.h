@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "BatchRunner.h"
+#include "Context.h"
+#include "Scheduler.h"
+
+// Runs many independent machines without windows, scheduling their
+// ticks across a pool of worker threads. A machine leaves the schedule
+// once its run stops, see BatchRunner, which includes going quiescent
+// after typing its input since nothing else can wake it.
+class Host
+{
+public:
+	Host(unsigned threadCount, unsigned ticksPerQuantum);
+
+	// Creates a machine, set it up before calling run()
+	Context & addMachine(std::vector<uint8_t> input, BatchRunner::Limits const & limits);
+
+	// Creates a machine that starts out as a copy of parent, sharing its
+	// memory and disk copy-on-write. Fork before calling run().
+	Context & forkMachine(Context & parent, std::vector<uint8_t> input, BatchRunner::Limits const & limits);
+
+	void run();
+
+	// Per machine and aggregate throughput of the last run
+	void printReport(std::ostream & out) const;
+private:
+	struct Machine {
+		std::unique_ptr<Context> context;
+		std::unique_ptr<BatchRunner> runner;
+		// Time spent running quanta, only touched by the worker
+		// currently running the machine
+		BatchRunner::Clock::duration busy;
+	};
+
+	Context & add(std::unique_ptr<Context> context, std::vector<uint8_t> input, BatchRunner::Limits const & limits);
+	bool runQuantum(unsigned machine);
+
+	Scheduler scheduler;
+	unsigned ticksPerQuantum;
+
+	std::vector<Machine> machines;
+
+	BatchRunner::Clock::duration elapsed;
+};
@@ -0,0 +1,112 @@
+#include "InputLog.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "common/FileUtil.h"
+#include "common/StateStream.h"
+
+namespace {
+
+char const logMagic[8] = {'E', 'F', 'P', 'C', 'K', 'E', 'Y', 'S'};
+// Version 1 logs predate the device switch setting, they always yield
+uint32_t const logVersion = 2;
+
+void writeStamp(StateWriter & out, InputLog::Stamp const & stamp)
+{
+	out.u32(stamp.tick);
+	out.u64(stamp.instructions);
+}
+
+InputLog::Stamp readStamp(StateReader & in)
+{
+	InputLog::Stamp stamp;
+	stamp.tick = in.u32();
+	stamp.instructions = in.u64();
+	return stamp;
+}
+
+}
+
+InputLog::Stamp InputLog::now(Processor const & processor)
+{
+	return Stamp{processor.getTicks(), processor.getInstructionCount()};
+}
+
+void InputLog::begin(Processor const & processor)
+{
+	cyclesPerTick = processor.getCyclesPerTick();
+	clockMode = processor.getClockMode();
+	deviceSwitchYields = processor.getDeviceSwitchYields();
+	start = end = now(processor);
+	events.clear();
+}
+
+void InputLog::record(Processor const & processor, uint8_t key)
+{
+	events.push_back(Event{now(processor), key});
+}
+
+void InputLog::finish(Processor const & processor)
+{
+	end = now(processor);
+}
+
+void InputLog::save(std::string const & filename) const
+{
+	StateWriter out;
+	for (char c : logMagic) {
+		out.u8(c);
+	}
+	out.u32(logVersion);
+	out.u32(cyclesPerTick);
+	out.u8(clockMode == Processor::ClockMode::Accurate ? 1 : 0);
+	out.boolean(deviceSwitchYields);
+	writeStamp(out, start);
+	writeStamp(out, end);
+
+	out.u32(events.size());
+	for (auto const & event : events) {
+		writeStamp(out, event.stamp);
+		out.u8(event.key);
+	}
+
+	saveFile(filename, out.getData());
+}
+
+InputLog InputLog::load(std::string const & filename)
+{
+	std::vector<uint8_t> const data = loadFile(filename);
+	StateReader in(data.data(), data.size());
+
+	uint8_t magic[sizeof(logMagic)];
+	in.bytes(magic, sizeof(magic));
+	if (!std::equal(magic, magic + sizeof(magic), reinterpret_cast<uint8_t const *>(logMagic))) {
+		throw std::runtime_error("'" + filename + "' is not an input log");
+	}
+	uint32_t const version = in.u32();
+	if (version < 1 || version > logVersion) {
+		throw std::runtime_error("Unsupported input log version in '" + filename + "'");
+	}
+
+	InputLog log;
+	log.cyclesPerTick = in.u32();
+	log.clockMode = in.u8() != 0 ? Processor::ClockMode::Accurate : Processor::ClockMode::Fast;
+	if (version >= 2) {
+		log.deviceSwitchYields = in.boolean();
+	}
+	log.start = readStamp(in);
+	log.end = readStamp(in);
+
+	uint32_t const count = in.u32();
+	for (uint32_t i = 0; i < count; ++i) {
+		Stamp const stamp = readStamp(in);
+		log.events.push_back(Event{stamp, in.u8()});
+	}
+
+	if (log.cyclesPerTick == 0) {
+		throw std::runtime_error("Input log '" + filename + "' has no clock rate");
+	}
+
+	return log;
+}
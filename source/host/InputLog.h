@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "computer/Processor.h"
+
+// Keys typed into a machine, each stamped with the processor tick it
+// arrived before and the instructions executed by then. Keys only reach
+// the guest between ticks, so typing them before the same ticks again
+// replays a session exactly, whatever the speed of the host. See
+// docs/replay.md.
+class InputLog
+{
+public:
+	struct Stamp {
+		uint32_t tick;
+		uint64_t instructions;
+
+		bool operator==(Stamp const & other) const
+		{
+			return tick == other.tick && instructions == other.instructions;
+		}
+	};
+
+	struct Event {
+		Stamp stamp;
+		uint8_t key;
+	};
+
+	static Stamp now(Processor const & processor);
+
+	// Recording, begin() once the processor is ready to run and finish()
+	// once it stopped
+	void begin(Processor const & processor);
+	void record(Processor const & processor, uint8_t key);
+	void finish(Processor const & processor);
+
+	unsigned getCyclesPerTick() const { return cyclesPerTick; };
+	Processor::ClockMode getClockMode() const { return clockMode; };
+	bool getDeviceSwitchYields() const { return deviceSwitchYields; };
+	Stamp const & getStart() const { return start; };
+	Stamp const & getEnd() const { return end; };
+	std::vector<Event> const & getEvents() const { return events; };
+
+	void save(std::string const & filename) const;
+	// Throws std::runtime_error if the file is not a valid log
+	static InputLog load(std::string const & filename);
+private:
+	unsigned cyclesPerTick = 0;
+	Processor::ClockMode clockMode = Processor::ClockMode::Fast;
+	bool deviceSwitchYields = true;
+
+	Stamp start = {0, 0};
+	Stamp end = {0, 0};
+	std::vector<Event> events;
+};
@@ -0,0 +1,97 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+Scheduler::Scheduler(unsigned threadCount) :
+	threadCount(threadCount),
+	workerCount(0),
+	queues(),
+	steals(0)
+{
+	assert(threadCount != 0);
+
+	for (unsigned i = 0; i < threadCount; ++i) {
+		queues.emplace_back(new WorkQueue);
+	}
+}
+
+void Scheduler::run(unsigned jobCount, Quantum const & quantum)
+{
+	if (jobCount == 0) {
+		return;
+	}
+
+	// Workers beyond one per job would find nothing to do
+	workerCount = std::min(threadCount, jobCount);
+	steals = 0;
+
+	for (unsigned job = 0; job < jobCount; ++job) {
+		push(job % workerCount, job);
+	}
+
+	std::vector<std::thread> workers;
+	for (unsigned worker = 1; worker < workerCount; ++worker) {
+		workers.emplace_back(&Scheduler::work, this, worker, std::cref(quantum));
+	}
+
+	work(0, quantum);
+
+	for (auto & worker : workers) {
+		worker.join();
+	}
+}
+
+void Scheduler::work(unsigned worker, Quantum const & quantum)
+{
+	unsigned job;
+	while (pop(worker, job) || steal(worker, job)) {
+		if (quantum(job)) {
+			push(worker, job);
+		}
+	}
+
+	// Every deque is empty, so the jobs left are running on other
+	// workers, one each. Those only ever requeue to their own worker,
+	// so this one would never find work again.
+}
+
+bool Scheduler::pop(unsigned worker, unsigned & job)
+{
+	WorkQueue & queue = *queues[worker];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.jobs.empty()) {
+		return false;
+	}
+
+	job = queue.jobs.front();
+	queue.jobs.pop_front();
+	return true;
+}
+
+bool Scheduler::steal(unsigned worker, unsigned & job)
+{
+	for (unsigned i = 1; i < workerCount; ++i) {
+		WorkQueue & queue = *queues[(worker + i) % workerCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.jobs.empty()) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+			++steals;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Scheduler::push(unsigned worker, unsigned job)
+{
+	WorkQueue & queue = *queues[worker];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	queue.jobs.push_back(job);
+}
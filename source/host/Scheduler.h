@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs quanta of many jobs on a fixed pool of worker threads. Every
+// worker owns a deque of jobs: it takes jobs round robin from the front
+// and requeues unfinished ones at the back. A worker whose deque runs
+// dry steals from the back of another worker's deque, so finished jobs
+// cost nothing and the remaining ones spread across all workers. A
+// worker that finds every deque empty exits rather than waiting.
+class Scheduler
+{
+public:
+	// Runs one quantum of a job, returns false once the job is finished
+	typedef std::function<bool(unsigned job)> Quantum;
+
+	explicit Scheduler(unsigned threadCount);
+
+	unsigned getThreadCount() const { return threadCount; };
+
+	// Workers used by the last run, at most one per job
+	unsigned getWorkerCount() const { return workerCount; };
+
+	// Runs jobs 0 to jobCount - 1 until all of them are finished. At
+	// most one quantum of a given job runs at a time.
+	void run(unsigned jobCount, Quantum const & quantum);
+
+	// Jobs taken from another worker's deque during the last run
+	uint64_t getSteals() const { return steals.load(); };
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<unsigned> jobs;
+	};
+
+	void work(unsigned worker, Quantum const & quantum);
+	bool pop(unsigned worker, unsigned & job);
+	bool steal(unsigned worker, unsigned & job);
+	void push(unsigned worker, unsigned job);
+
+	unsigned threadCount;
+	unsigned workerCount;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+
+	std::atomic<uint64_t> steals;
+};
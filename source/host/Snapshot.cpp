@@ -0,0 +1,158 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "Context.h"
+#include "common/MappedFile.h"
+#include "common/StateStream.h"
+
+namespace {
+
+char const magic[8] = {'E', 'F', 'P', 'C', 'S', 'N', 'A', 'P'};
+uint32_t const version = 1;
+
+unsigned const headerSize = 48;
+uint64_t const memoryOffset = 4096;
+
+// Memory has to start on a page boundary to be mapped
+uint64_t const memoryAlignment = 4096;
+
+// Section tags, in file order
+uint32_t const processorTag = 0x20555043;   // "CPU "
+uint32_t const consoleTag = 0x534e4f43;     // "CONS"
+uint32_t const floppyDriveTag = 0x4b534944; // "DISK"
+
+template <typename Device>
+void writeSection(StateWriter & out, uint32_t tag, Device const & device)
+{
+	StateWriter section;
+	device.saveState(section);
+
+	out.u32(tag);
+	out.blob(section.getData());
+}
+
+template <typename Device>
+void readSection(StateReader & in, uint32_t tag, Device & device)
+{
+	if (in.u32() != tag) {
+		throw std::runtime_error("Snapshot sections are out of order");
+	}
+
+	std::vector<uint8_t> const data = in.blob();
+	StateReader section(data.data(), data.size());
+	device.loadState(section);
+}
+
+void readSections(Context & context, std::vector<uint8_t> const & data)
+{
+	StateReader state(data.data(), data.size());
+	readSection(state, processorTag, context.processor);
+	readSection(state, consoleTag, context.console);
+	readSection(state, floppyDriveTag, context.drive);
+}
+
+}
+
+void saveSnapshot(Context const & context, std::string const & filename)
+{
+	StateWriter state;
+	writeSection(state, processorTag, context.processor);
+	writeSection(state, consoleTag, context.console);
+	writeSection(state, floppyDriveTag, context.drive);
+
+	uint64_t const stateOffset = memoryOffset + Processor::memorySize;
+
+	StateWriter header;
+	header.bytes(reinterpret_cast<uint8_t const *>(magic), sizeof(magic));
+	header.u32(version);
+	header.u32(headerSize);
+	header.u64(memoryOffset);
+	header.u64(Processor::memorySize);
+	header.u64(stateOffset);
+	header.u64(state.getData().size());
+
+	std::vector<uint8_t> file(memoryOffset + Processor::memorySize);
+	std::copy(header.getData().begin(), header.getData().end(), file.begin());
+	context.processor.copyMemory(file.data() + memoryOffset);
+	file.insert(file.end(), state.getData().begin(), state.getData().end());
+
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	if (!out.write(reinterpret_cast<char const *>(file.data()), file.size())) {
+		throw std::runtime_error(
+			std::string("Unable to write snapshot '") + filename + "'");
+	}
+}
+
+void restoreSnapshot(Context & context, std::string const & filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error(
+			std::string("Unable to open file '") + filename + "'");
+	}
+
+	uint8_t headerData[headerSize];
+	if (!file.read(reinterpret_cast<char *>(headerData), headerSize)) {
+		throw std::runtime_error(
+			std::string("File '") + filename + "' is not a snapshot");
+	}
+
+	StateReader header(headerData, headerSize);
+
+	uint8_t fileMagic[sizeof(magic)];
+	header.bytes(fileMagic, sizeof(fileMagic));
+	if (!std::equal(fileMagic, fileMagic + sizeof(magic), reinterpret_cast<uint8_t const *>(magic))) {
+		throw std::runtime_error(
+			std::string("File '") + filename + "' is not a snapshot");
+	}
+	if (header.u32() != version) {
+		throw std::runtime_error(
+			std::string("Snapshot '") + filename + "' has an unsupported version");
+	}
+
+	header.u32();
+	uint64_t const fileMemoryOffset = header.u64();
+	uint64_t const memorySize = header.u64();
+	uint64_t const stateOffset = header.u64();
+	uint64_t const stateSize = header.u64();
+
+	if (memorySize != Processor::memorySize) {
+		throw std::runtime_error(
+			std::string("Snapshot '") + filename + "' has a different memory size");
+	}
+	if (fileMemoryOffset % memoryAlignment != 0) {
+		throw std::runtime_error(
+			std::string("Snapshot '") + filename + "' has misaligned memory");
+	}
+
+	// Check the sections against the file before trusting their sizes
+	file.seekg(0, std::ios::end);
+	uint64_t const fileSize = uint64_t(file.tellg());
+	if (fileMemoryOffset > fileSize || memorySize > fileSize - fileMemoryOffset
+		|| stateOffset > fileSize || stateSize > fileSize - stateOffset)
+	{
+		throw std::runtime_error(
+			std::string("Snapshot '") + filename + "' is truncated");
+	}
+
+	std::vector<uint8_t> stateData(stateSize);
+	file.seekg(stateOffset);
+	if (!file.read(reinterpret_cast<char *>(stateData.data()), stateData.size())) {
+		throw std::runtime_error(
+			std::string("Snapshot '") + filename + "' is truncated");
+	}
+
+	std::shared_ptr<uint8_t> memory = mapFile(filename, fileMemoryOffset, memorySize);
+
+	// A malformed section has to leave the machine as it was, so the
+	// state is tried on a scratch fork first
+	readSections(*context.fork(), stateData);
+	readSections(context, stateData);
+
+	context.processor.setMemory(std::move(memory));
+}
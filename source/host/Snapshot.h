@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+struct Context;
+
+// Saves and restores the complete state of a machine, see
+// docs/snapshot.md for the file format. Restoring maps the memory from
+// the file, so it is only read as the guest touches it. Both throw
+// std::runtime_error on I/O errors and malformed files.
+void saveSnapshot(Context const & context, std::string const & filename);
+void restoreSnapshot(Context & context, std::string const & filename);
@@ -0,0 +1,116 @@
+#include "TerminalInput.h"
+
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EFORTHPC_TERMIOS
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+#else
+struct termios {};
+#endif
+
+bool TerminalInput::isSupported()
+{
+#ifdef EFORTHPC_TERMIOS
+	return true;
+#else
+	return false;
+#endif
+}
+
+TerminalInput::TerminalInput() :
+	savedMode(),
+	escape(Escape::None),
+	atEnd(false)
+{
+#ifdef EFORTHPC_TERMIOS
+	termios mode;
+	if (tcgetattr(STDIN_FILENO, &mode) != 0) {
+		// Not a terminal, keys are read as they come
+		return;
+	}
+
+	savedMode.reset(new termios(mode));
+	mode.c_lflag &= ~(ICANON | ECHO);
+	mode.c_cc[VMIN] = 1;
+	mode.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &mode);
+#endif
+}
+
+TerminalInput::~TerminalInput()
+{
+#ifdef EFORTHPC_TERMIOS
+	if (savedMode) {
+		tcsetattr(STDIN_FILENO, TCSANOW, savedMode.get());
+	}
+#endif
+}
+
+void TerminalInput::readKeys(std::chrono::microseconds timeout, std::vector<uint8_t> & keys)
+{
+#ifdef EFORTHPC_TERMIOS
+	if (atEnd) {
+		std::this_thread::sleep_for(timeout);
+		return;
+	}
+
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(STDIN_FILENO, &readable);
+
+	timeval wait;
+	wait.tv_sec = timeout.count() / 1000000;
+	wait.tv_usec = timeout.count() % 1000000;
+	if (select(STDIN_FILENO + 1, &readable, nullptr, nullptr, &wait) <= 0) {
+		return;
+	}
+
+	uint8_t buffer[64];
+	ssize_t const count = read(STDIN_FILENO, buffer, sizeof(buffer));
+	if (count <= 0) {
+		// Closed stdin stays readable, stop polling it
+		atEnd = true;
+		return;
+	}
+
+	for (ssize_t i = 0; i < count; ++i) {
+		uint8_t code = buffer[i];
+
+		switch (escape) {
+		case Escape::Started:
+			escape = code == '[' || code == 'O' ? Escape::Sequence : Escape::None;
+			continue;
+		case Escape::Sequence:
+			// Ends with a byte from 0x40 to 0x7e
+			if (code >= 0x40 && code <= 0x7e) {
+				escape = Escape::None;
+			}
+			continue;
+		case Escape::None:
+			break;
+		}
+
+		if (code == 0x1b) {
+			escape = Escape::Started;
+			continue;
+		}
+
+		// Like the window: Enter as CR, and Backspace as BS rather than
+		// the DEL most terminals send
+		if (code == 10) {
+			code = 13;
+		} else if (code == 127) {
+			code = 8;
+		}
+		if (code > 0 && code <= 127) {
+			keys.push_back(code);
+		}
+	}
+#else
+	(void)keys;
+	std::this_thread::sleep_for(timeout);
+#endif
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct termios;
+
+// Reads keys from stdin without waiting for a line or echoing them.
+// Only supported on POSIX hosts.
+class TerminalInput
+{
+public:
+	static bool isSupported();
+
+	// Puts stdin in raw mode if it is a terminal, the destructor restores
+	// it. Signals such as Ctrl+C still reach the process.
+	TerminalInput();
+	~TerminalInput();
+
+	TerminalInput(TerminalInput const &) = delete;
+	TerminalInput & operator=(TerminalInput const &) = delete;
+
+	// Waits up to timeout for input and appends the keys read, as
+	// console key codes, to keys. Escape sequences such as arrow keys
+	// are dropped.
+	void readKeys(std::chrono::microseconds timeout, std::vector<uint8_t> & keys);
+private:
+	std::unique_ptr<termios> savedMode;
+
+	// Escape sequences can be split over reads
+	enum class Escape {
+		None,
+		Started,
+		Sequence
+	};
+	Escape escape;
+
+	bool atEnd;
+};
@@ -0,0 +1,155 @@
+#include "TerminalRenderer.h"
+
+#include <cstring>
+
+namespace {
+
+unsigned const width = Console::screenWidth;
+unsigned const height = Console::screenHeight;
+
+// Equal cells between two changed ones are sent again rather than
+// skipped when that is no longer than moving the cursor over them
+unsigned const maxGap = 6;
+
+// Returns the first column from column on where the rows differ, width
+// if none. Compares eight cells at a time while they match.
+unsigned findChange(uint8_t const * cells, uint8_t const * previous, unsigned column)
+{
+	static_assert(width % 8 == 0, "rows are compared in words");
+
+	for (; column < width; column += 8) {
+		uint64_t a;
+		uint64_t b;
+		std::memcpy(&a, cells + column, 8);
+		std::memcpy(&b, previous + column, 8);
+		if (a != b) {
+			break;
+		}
+	}
+
+	while (column < width && cells[column] == previous[column]) {
+		++column;
+	}
+
+	return column;
+}
+
+}
+
+TerminalRenderer::TerminalRenderer() :
+	output(),
+	previous(),
+	cleared(false),
+	inverse(false),
+	cursorPlaced(false),
+	cursorX(0),
+	cursorY(0),
+	cursorVisible(false),
+	bytesRendered(0)
+{}
+
+std::string const & TerminalRenderer::render(Console::Snapshot const & snapshot)
+{
+	output.clear();
+
+	bool const full = !cleared;
+	if (full) {
+		// Reset attributes, hide the cursor and clear the screen
+		output += "\x1b[m\x1b[?25l\x1b[2J";
+		inverse = false;
+		cursorVisible = false;
+		cleared = true;
+	}
+
+	for (unsigned row = 0; row < height; ++row) {
+		uint8_t const * const cells = &snapshot.screen[row * width];
+		if (full || std::memcmp(cells, &previous[row * width], width) != 0) {
+			renderRow(row, cells, full);
+		}
+	}
+	previous = snapshot.screen;
+
+	if (inverse) {
+		output += "\x1b[27m";
+		inverse = false;
+	}
+
+	if (!output.empty()) {
+		cursorPlaced = false;
+	}
+
+	bool const visible = snapshot.cursorMode != 0
+		&& snapshot.cursorX < width && snapshot.cursorY < height;
+	if (visible && (!cursorPlaced || snapshot.cursorX != cursorX || snapshot.cursorY != cursorY)) {
+		moveTo(snapshot.cursorY, snapshot.cursorX);
+		cursorPlaced = true;
+		cursorX = snapshot.cursorX;
+		cursorY = snapshot.cursorY;
+	}
+	if (visible != cursorVisible) {
+		output += visible ? "\x1b[?25h" : "\x1b[?25l";
+		cursorVisible = visible;
+	}
+
+	bytesRendered += output.size();
+	return output;
+}
+
+std::string const & TerminalRenderer::finish()
+{
+	output.clear();
+	if (cleared) {
+		output += "\x1b[m\x1b[?25h";
+		moveTo(height, 0);
+	}
+
+	bytesRendered += output.size();
+	return output;
+}
+
+void TerminalRenderer::renderRow(unsigned row, uint8_t const * cells, bool full)
+{
+	uint8_t const * const before = &previous[row * width];
+
+	unsigned column = full ? 0 : findChange(cells, before, 0);
+	while (column < width) {
+		unsigned const start = column;
+		unsigned end = start + 1;
+
+		// Take in later changes unless too many equal cells come first
+		for (unsigned next = end; next < width && next - end <= maxGap; ++next) {
+			if (full || cells[next] != before[next]) {
+				end = next + 1;
+			}
+		}
+
+		moveTo(row, start);
+		for (unsigned i = start; i < end; ++i) {
+			putCell(cells[i]);
+		}
+
+		column = full ? width : findChange(cells, before, end);
+	}
+}
+
+void TerminalRenderer::moveTo(unsigned row, unsigned column)
+{
+	output += "\x1b[";
+	output += std::to_string(row + 1);
+	output += ';';
+	output += std::to_string(column + 1);
+	output += 'H';
+}
+
+void TerminalRenderer::putCell(uint8_t symbol)
+{
+	// The top bit inverts a character
+	bool const inverted = symbol & 0x80;
+	if (inverted != inverse) {
+		output += inverted ? "\x1b[7m" : "\x1b[27m";
+		inverse = inverted;
+	}
+
+	char const character = symbol & 0x7f;
+	output += character >= 0x20 && character < 0x7f ? character : '?';
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "computer/Console.h"
+
+// Renders console snapshots as ANSI escape sequences for a terminal of
+// at least 80x50. After the first frame only the runs of cells that
+// changed since the previous frame are sent, and the cursor is the
+// terminal's own.
+class TerminalRenderer
+{
+public:
+	TerminalRenderer();
+
+	// Returns the output for the frame, valid until the next call
+	std::string const & render(Console::Snapshot const & snapshot);
+	// Returns the output leaving the terminal as it was, below the screen
+	std::string const & finish();
+
+	uint64_t getBytesRendered() const { return bytesRendered; };
+private:
+	typedef std::array<uint8_t, Console::screenWidth*Console::screenHeight> Screen;
+
+	void renderRow(unsigned row, uint8_t const * cells, bool full);
+	void moveTo(unsigned row, unsigned column);
+	void putCell(uint8_t symbol);
+
+	std::string output;
+
+	// What the terminal shows
+	Screen previous;
+	bool cleared;
+	bool inverse;
+	// Where the terminal cursor was placed, unless cells were written
+	// since
+	bool cursorPlaced;
+	uint8_t cursorX;
+	uint8_t cursorY;
+	bool cursorVisible;
+
+	uint64_t bytesRendered;
+};
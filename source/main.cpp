@@ -1,15 +1,29 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <SFML/Graphics.hpp>
 
 #include "common/FileUtil.h"
-#include "computer/Console.h"
+#include "common/Signal.h"
 #include "computer/Floppy.h"
-#include "computer/FloppyDrive.h"
-#include "computer/Processor.h"
-#include "computer/RedbusNetwork.h"
+#include "computer/Profiler.h"
+#include "computer/Tracer.h"
+#include "host/BatchRunner.h"
+#include "host/Context.h"
+#include "host/Host.h"
+#include "host/InputLog.h"
+#include "host/Snapshot.h"
+#include "host/TerminalInput.h"
+#include "host/TerminalRenderer.h"
 
 namespace {
 
@@ -20,61 +34,381 @@ constexpr unsigned screenHeight = 230;
 constexpr bool     useVsync       = false;
 constexpr unsigned framerateLimit = 144;
 
-constexpr uint8_t consoleAddress     = 0x01;
-constexpr uint8_t floppyDriveAddress = 0x02;
-constexpr uint8_t processorAddress   = 0x00;
+// Default microseconds per time quanta, 50 ms or 20Hz. The clock rate
+// defaults to the processor's cycles per tick at this quanta.
+constexpr unsigned long defaultUsPerTick = 50 * 1000;
 
-// Microseconds per time quanta.
-// See computer/Processor.cpp for CPU Clock timings.
-constexpr long usPerTick = 50 * 1000; // 50 ms, 20Hz
+// Default trace capacity in records, about 75 MB
+constexpr unsigned long defaultTraceSize = 4 * 1024 * 1024;
+
+// Default milliseconds between writing the disk back
+constexpr unsigned long defaultSyncMs = 1000;
+
+// Set by SIGUSR1, the thread running the machine writes the profile and
+// the trace
+std::atomic<bool> dumpRequested(false);
+
+void requestDump(int) {
+	dumpRequested.store(true);
+}
+
+// Set by SIGINT and SIGTERM in terminal mode, which leaves the terminal
+// as it found it before exiting
+std::atomic<bool> stopRequested(false);
+
+void requestStop(int) {
+	stopRequested.store(true);
+}
+
+bool parseNumber(std::string const & text, unsigned long & value) {
+	char * end = nullptr;
+	value = std::strtoul(text.c_str(), &end, 10);
+	return !text.empty() && *end == '\0' && value > 0;
+}
 
 }
 
 void printUsage(std::string const & program) {
-	std::cout << "Usage:\n     " << program << " <disk-image>" << std::endl;
+	std::cout << "Usage:\n     " << program << " [options] <disk-image>\n"
+		<< "     " << program << " [options] --restore <snapshot>\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "     --jit                 Translate hot code to x86-64 instead of interpreting it\n"
+		<< "     --clock <hz>          Processor clock rate in cycles per second (default 200000)\n"
+		<< "     --clock-mode <mode>   'fast' charges one cycle per instruction, 'accurate'\n"
+		<< "                           charges each opcode its cycle cost (default fast)\n"
+		<< "     --tick-us <us>        Length of a time quanta in microseconds (default 50000)\n"
+		<< "     --fast-device-switch  Mapping another Redbus device does not end the tick\n"
+		<< "     --write-back          Write the sectors the guest writes back to the disk\n"
+		<< "                           image, every --sync-ms, when the guest idles and\n"
+		<< "                           when the machine stops\n"
+		<< "     --sync-ms <ms>        Milliseconds between writing the disk back\n"
+		<< "                           (default 1000)\n"
+		<< "     --restore <file>      Start from a snapshot instead of booting, the disk in\n"
+		<< "                           the snapshot replaces the disk image\n"
+		<< "     --save <file>         Save a snapshot of the machine when it stops\n"
+		<< "     --profile <name>      Count executions per address, opcode and Redbus\n"
+		<< "                           access, runs interpreted. Writes a report to\n"
+		<< "                           name.txt and raw counts to name.bin when the\n"
+		<< "                           machine stops and on SIGUSR1\n"
+		<< "     --trace <file>        Record the last instructions, memory writes and\n"
+		<< "                           Redbus accesses, runs interpreted. Writes them to\n"
+		<< "                           file when the machine stops or halts and on SIGUSR1,\n"
+		<< "                           read it with trace-decode\n"
+		<< "     --trace-size <n>      Records kept by --trace (default 4194304)\n"
+		<< "     --record <file>       Log every key typed with the tick it reached the\n"
+		<< "                           machine at, written when the machine stops\n"
+		<< "\n"
+		<< "Turbo mode:\n"
+		<< "     --turbo               Run headless and unthrottled, print the screen and\n"
+		<< "                           the instruction rate when stopping. Stops when the\n"
+		<< "                           processor halts or on any of the conditions below,\n"
+		<< "                           which are checked between ticks\n"
+		<< "     --input <file>        Type the contents of a file on the keyboard\n"
+		<< "     --max-instructions <n>\n"
+		<< "                           Stop after executing n instructions\n"
+		<< "     --max-ms <ms>         Stop after ms milliseconds of wall clock time\n"
+		<< "     --stop-on-idle        Stop once the input is consumed and the guest idles\n"
+		<< "                           on WAI without writing to any device\n"
+		<< "     --replay <file>       Type the keys of a --record log at the ticks they were\n"
+		<< "                           recorded at instead of the input, using its clock\n"
+		<< "                           and device switch setting.\n"
+		<< "                           Stops at the end of the log or if the run diverges\n"
+		<< "\n"
+		<< "Terminal mode:\n"
+		<< "     --terminal            Draw the screen in the terminal, of at least 80x50,\n"
+		<< "                           with ANSI escape sequences instead of a window and\n"
+		<< "                           read the keyboard from stdin. Ctrl+C quits\n"
+		<< "\n"
+		<< "Host mode:\n"
+		<< "     --host <n>            Run n independent machines in turbo mode, each typing\n"
+		<< "                           the same input, and report their throughput. A\n"
+		<< "                           machine stops once it has typed its input and\n"
+		<< "                           waits for more\n"
+		<< "     --threads <n>         Worker threads for the machines (default: one per core)"
+		<< std::endl;
 }
 
-struct Context {
-public:
-	RedbusNetwork net;
+struct Options {
+	std::string diskImage;
+	bool useJit = false;
 
-	Console console;
-	FloppyDrive drive;
-	Processor processor;
+	unsigned long clockHz = 0;
+	unsigned long usPerTick = defaultUsPerTick;
+	Processor::ClockMode clockMode = Processor::ClockMode::Fast;
+	bool fastDeviceSwitch = false;
+	bool writeBack = false;
+	unsigned long syncMs = defaultSyncMs;
 
-	sf::RenderWindow window;
+	std::string restoreFile;
+	std::string saveFile;
+	std::string profileFile;
+	std::string traceFile;
+	unsigned long traceSize = defaultTraceSize;
+	std::string recordFile;
+	std::string replayFile;
+
+	bool turbo = false;
+	std::string inputFile;
+	unsigned long maxInstructions = 0;
+	unsigned long maxMs = 0;
+	bool stopOnIdle = false;
 
-	Context(uint8_t consoleAdr, uint8_t driveAdr, uint8_t cpuAdr,
-			uint8_t bankCount) :
-		console(net, consoleAdr),
-		drive(net, driveAdr),
-		processor(net, bankCount, cpuAdr),
-		window()
-	{}
+	bool terminal = false;
+
+	unsigned long hostMachines = 0;
+	unsigned long hostThreads = 0;
 };
 
-void mainLoop(Context & context) {
-	unsigned long tickTimer = 0;
-	unsigned long ticks     = 0;
+bool parseArguments(std::vector<std::string> const & arguments, Options & options) {
+	for (std::size_t i = 1; i < arguments.size(); ++i) {
+		std::string const & argument = arguments[i];
+
+		bool const hasValue = i + 1 < arguments.size();
+
+		if (argument == "--jit") {
+			options.useJit = true;
+		} else if (argument == "--clock" && hasValue) {
+			if (!parseNumber(arguments[++i], options.clockHz)) {
+				std::cout << "Invalid clock rate '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--tick-us" && hasValue) {
+			if (!parseNumber(arguments[++i], options.usPerTick)) {
+				std::cout << "Invalid tick length '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--clock-mode" && hasValue) {
+			std::string const & mode = arguments[++i];
+			if (mode == "fast") {
+				options.clockMode = Processor::ClockMode::Fast;
+			} else if (mode == "accurate") {
+				options.clockMode = Processor::ClockMode::Accurate;
+			} else {
+				std::cout << "Unknown clock mode '" << mode << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--fast-device-switch") {
+			options.fastDeviceSwitch = true;
+		} else if (argument == "--write-back") {
+			options.writeBack = true;
+		} else if (argument == "--sync-ms" && hasValue) {
+			if (!parseNumber(arguments[++i], options.syncMs)) {
+				std::cout << "Invalid sync interval '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--restore" && hasValue) {
+			options.restoreFile = arguments[++i];
+		} else if (argument == "--save" && hasValue) {
+			options.saveFile = arguments[++i];
+		} else if (argument == "--profile" && hasValue) {
+			options.profileFile = arguments[++i];
+		} else if (argument == "--trace" && hasValue) {
+			options.traceFile = arguments[++i];
+		} else if (argument == "--trace-size" && hasValue) {
+			if (!parseNumber(arguments[++i], options.traceSize)) {
+				std::cout << "Invalid trace size '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--record" && hasValue) {
+			options.recordFile = arguments[++i];
+		} else if (argument == "--replay" && hasValue) {
+			options.replayFile = arguments[++i];
+		} else if (argument == "--turbo") {
+			options.turbo = true;
+		} else if (argument == "--input" && hasValue) {
+			options.inputFile = arguments[++i];
+		} else if (argument == "--max-instructions" && hasValue) {
+			if (!parseNumber(arguments[++i], options.maxInstructions)) {
+				std::cout << "Invalid instruction budget '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--max-ms" && hasValue) {
+			if (!parseNumber(arguments[++i], options.maxMs)) {
+				std::cout << "Invalid time limit '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--stop-on-idle") {
+			options.stopOnIdle = true;
+		} else if (argument == "--terminal") {
+			options.terminal = true;
+		} else if (argument == "--host" && hasValue) {
+			if (!parseNumber(arguments[++i], options.hostMachines)) {
+				std::cout << "Invalid machine count '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument == "--threads" && hasValue) {
+			if (!parseNumber(arguments[++i], options.hostThreads)) {
+				std::cout << "Invalid thread count '" << arguments[i] << "'" << std::endl;
+				return false;
+			}
+		} else if (argument.size() > 1 && argument[0] == '-') {
+			std::cout << "Unknown option '" << argument << "'" << std::endl;
+			return false;
+		} else if (options.diskImage.empty()) {
+			options.diskImage = argument;
+		} else {
+			return false;
+		}
+	}
+
+	return !options.diskImage.empty() || !options.restoreFile.empty();
+}
+
+// Writes the report and the raw counts of a profiled machine
+void writeProfile(Context const & context, std::string const & name) {
+	Profiler const * profiler = context.processor.getProfiler();
+
+	std::ofstream report(name + ".txt");
+	profiler->writeReport(report);
+	profiler->writeHistogram(name + ".bin");
+
+	std::cout << "Profile written to " << name << ".txt and " << name << ".bin" << std::endl;
+}
+
+void writeTrace(Context const & context, std::string const & filename) {
+	context.processor.getTracer()->save(filename);
+
+	std::cout << "Trace written to " << filename << std::endl;
+}
 
-	sf::Clock frameTimer;
-	frameTimer.restart();
+void writeDump(Context const & context, Options const & options) {
+	if (!options.profileFile.empty()) {
+		writeProfile(context, options.profileFile);
+	}
+	if (!options.traceFile.empty()) {
+		writeTrace(context, options.traceFile);
+	}
+}
 
-	context.processor.warmBoot();
+// Called between ticks by the thread running the machine
+void checkDumpRequest(Context const & context, Options const & options) {
+	if (dumpRequested.exchange(false)) {
+		writeDump(context, options);
+	}
+}
+
+// Called between ticks by the thread running the machine, writes the
+// disk back once syncMs passed since the last time
+void checkDiskSync(Context & context, Options const & options, std::chrono::steady_clock::time_point & nextSync) {
+	if (!options.writeBack) {
+		return;
+	}
+
+	std::chrono::steady_clock::time_point const now = std::chrono::steady_clock::now();
+	if (now >= nextSync) {
+		context.drive.syncDisk();
+		nextSync = now + std::chrono::milliseconds(options.syncMs);
+	}
+}
+
+// Runs the processor and the Redbus devices at usPerTick per tick until
+// stopped. Only this thread touches them, the render thread talks to
+// the console through its key queue and snapshots and wakes this thread
+// through wakeup. Keys are logged to recorder unless it is null.
+void emulationLoop(Context & context, Options const & options, InputLog * recorder, std::atomic<bool> const & running, Signal & wakeup) {
+	typedef std::chrono::steady_clock Clock;
+
+	std::chrono::microseconds const tickLength(options.usPerTick);
+	unsigned long ticks = 0;
+
+	// A restored processor carries on where it was saved
+	if (context.processor.isHalted()) {
+		context.processor.warmBoot();
+	}
+	if (recorder != nullptr) {
+		recorder->begin(context.processor);
+	}
+
+	// The trace is written as soon as the processor halts, the window
+	// may stay open for a long time after
+	bool traceWritten = false;
+
+	Clock::time_point nextTick = Clock::now() + tickLength;
+	Clock::time_point nextSync = nextTick;
+	while (running.load(std::memory_order_relaxed)) {
+		if (context.processor.isQuiescent() && !context.console.hasPendingKeys()) {
+			// The guest is done saving for now
+			if (options.writeBack) {
+				context.drive.syncDisk();
+			}
+
+			// Ticks would change nothing until a key arrives, so sleep
+			// until then, or until the cursor blinks
+			if (context.console.isCursorBlinking()) {
+				unsigned long const untilBlink = Console::cursorBlinkTicks - ticks % Console::cursorBlinkTicks;
+				wakeup.waitUntil(nextTick + (untilBlink - 1) * tickLength);
+			} else {
+				wakeup.wait();
+			}
+
+			// Skip the ticks slept through, they only count for the blink
+			Clock::time_point const now = Clock::now();
+			while (nextTick <= now) {
+				nextTick += tickLength;
+				++ticks;
+			}
+		} else {
+			std::this_thread::sleep_until(nextTick);
+
+			// Catch up on ticks missed while the host was busy
+			Clock::time_point const now = Clock::now();
+			while (nextTick <= now) {
+				nextTick += tickLength;
+				++ticks;
+
+				context.processor.runTick();
+			}
+		}
+
+		uint8_t key;
+		while (context.console.receiveKey(key)) {
+			if (recorder != nullptr) {
+				recorder->record(context.processor, key);
+			}
+		}
+		context.console.publishSnapshot(ticks);
+
+		if (!options.traceFile.empty() && context.processor.isHalted() && !traceWritten) {
+			writeTrace(context, options.traceFile);
+			traceWritten = true;
+		}
+
+		checkDumpRequest(context, options);
+		checkDiskSync(context, options, nextSync);
+	}
+
+	if (recorder != nullptr) {
+		recorder->finish(context.processor);
+	}
+}
+
+void mainLoop(Context & context, sf::RenderWindow & window, Options const & options, InputLog * recorder) {
+	std::atomic<bool> running(true);
+	Signal wakeup;
+	std::thread emulation(emulationLoop, std::ref(context), std::cref(options), recorder, std::cref(running), std::ref(wakeup));
+
+	std::chrono::microseconds const frameLength(1000000 / framerateLimit);
+
+	while (window.isOpen()) {
+		// Redraw after window events and new snapshots only
+		bool redraw = false;
 
-	while (context.window.isOpen()) {
 		sf::Event event;
-		while (context.window.pollEvent(event)) {
+		while (window.pollEvent(event)) {
+			redraw = true;
+
 			switch (event.type) {
 			case sf::Event::Closed:
-				context.window.close(); break;
+				window.close(); break;
 			case sf::Event::TextEntered: {
 				uint8_t code = event.text.unicode;
 				if (code == 10) {
 					code = 13;
 				}
 				if (code > 0 && code <= 127) {
-					context.console.pushKey(code);
+					context.console.postKey(code);
+					wakeup.notify();
 				}
 				break;
 			}
@@ -83,56 +417,309 @@ void mainLoop(Context & context) {
 			}
 		}
 
-		sf::Time delta = frameTimer.restart();
-		tickTimer += delta.asMicroseconds();
+		if (redraw || context.console.hasNewSnapshot()) {
+			window.clear();
+			context.console.draw(window);
+			window.display();
+		} else {
+			std::this_thread::sleep_for(frameLength);
+		}
+	}
 
-		while (tickTimer >= usPerTick) {
-			tickTimer -= usPerTick;
-			++ticks;
+	running.store(false, std::memory_order_relaxed);
+	wakeup.notify();
+	emulation.join();
+}
 
-			context.processor.runTick();
+// Like mainLoop, on the terminal stdin and stdout are attached to
+void terminalLoop(Context & context, Options const & options, InputLog * recorder) {
+	std::atomic<bool> running(true);
+	Signal wakeup;
+	std::thread emulation(emulationLoop, std::ref(context), std::cref(options), recorder, std::cref(running), std::ref(wakeup));
+
+	std::chrono::microseconds const frameLength(1000000 / framerateLimit);
+
+	TerminalInput input;
+	TerminalRenderer renderer;
+	std::vector<uint8_t> keys;
+
+	while (!stopRequested.load()) {
+		// Doubles as the frame limit
+		keys.clear();
+		input.readKeys(frameLength, keys);
+		for (uint8_t key : keys) {
+			context.console.postKey(key);
+		}
+		if (!keys.empty()) {
+			wakeup.notify();
 		}
 
-		context.window.clear();
-		context.console.draw(context.window, ticks);
-		context.window.display();
+		if (context.console.hasNewSnapshot()) {
+			std::string const & frame = renderer.render(context.console.readSnapshot());
+			if (!frame.empty()) {
+				std::cout << frame << std::flush;
+			}
+		}
 	}
+
+	running.store(false, std::memory_order_relaxed);
+	wakeup.notify();
+	emulation.join();
+
+	std::cout << renderer.finish() << std::flush;
 }
 
-int main(int argc, char * argv[]) {
-	std::vector<std::string> const arguments(argv, argv + argc);
-	if (arguments.size() < 2) {
-		printUsage(arguments[0]);
+std::vector<uint8_t> loadInput(Options const & options) {
+	if (options.inputFile.empty()) {
+		return {};
+	}
+
+	return loadFile(options.inputFile);
+}
+
+BatchRunner::Limits batchLimits(Options const & options, BatchRunner::Clock::time_point start) {
+	BatchRunner::Limits limits;
+	limits.maxInstructions = options.maxInstructions;
+	if (options.maxMs != 0) {
+		limits.deadline = start + std::chrono::milliseconds(options.maxMs);
+	}
+	limits.stopOnIdle = options.stopOnIdle;
+
+	return limits;
+}
+
+// Sets up the clock, the JIT and the boot disk or restores the snapshot,
+// exits on bad options. Returns false if the JIT was asked for but is
+// not supported.
+bool configureMachine(Context & context, Options const & options, Floppy const & bootDisk) {
+	unsigned long cyclesPerTick = Processor::defaultCyclesPerTick;
+	if (options.clockHz != 0) {
+		cyclesPerTick = options.clockHz * options.usPerTick / 1000000;
+	} else if (options.usPerTick != defaultUsPerTick) {
+		// Keep the default clock rate
+		cyclesPerTick = cyclesPerTick * options.usPerTick / defaultUsPerTick;
+	}
+	if (cyclesPerTick == 0 || cyclesPerTick > 100 * 1000 * 1000) {
+		std::cout << "Clock rate gives " << cyclesPerTick
+			<< " cycles per tick, must be between 1 and 100000000" << std::endl;
 		std::exit(1);
 	}
+	context.processor.setClock(cyclesPerTick, options.clockMode);
+	context.processor.setDeviceSwitchYields(!options.fastDeviceSwitch);
+	context.processor.setProfiling(!options.profileFile.empty());
+	if (!options.traceFile.empty()) {
+		context.processor.setTracing(options.traceSize);
+	}
 
-	// Configure RedBus network
-	Context context(consoleAddress, floppyDriveAddress, processorAddress, 8);
+	if (!options.diskImage.empty()) {
+		context.drive.setDisk(bootDisk);
+	}
+	if (!options.restoreFile.empty()) {
+		restoreSnapshot(context, options.restoreFile);
+	}
 
-	// Load boot image into floppy drive
-	Floppy bootDisk(arguments[1], loadFile(arguments[1]));
-	context.drive.setDisk(bootDisk);
+	return !options.useJit || context.processor.setJitEnabled(true);
+}
 
-	// Warm boot the 65EL02
-	// context.processor.warmBoot();
+void warnNoJit() {
+	std::cout << "JIT is not supported on this host, using the interpreter" << std::endl;
+}
+
+// Runs ticks back to back without a window until a stop condition hits,
+// replay and recorder are used unless null
+void turboLoop(Context & context, Options const & options, InputLog const * replay, InputLog * recorder) {
+	BatchRunner::Clock::time_point const start = BatchRunner::Clock::now();
+
+	BatchRunner runner(context, loadInput(options), batchLimits(options, start));
+	if (replay != nullptr) {
+		runner.setReplay(*replay);
+	}
+	if (recorder != nullptr) {
+		runner.setRecorder(*recorder);
+	}
 
+	BatchRunner::Clock::time_point nextSync = start;
+
+	runner.start();
+	while (runner.runTicks(1)) {
+		checkDumpRequest(context, options);
+		checkDiskSync(context, options, nextSync);
+	}
+
+	if (recorder != nullptr) {
+		recorder->finish(context.processor);
+	}
+
+	double const seconds = std::chrono::duration<double>(BatchRunner::Clock::now() - start).count();
+	uint64_t const executed = runner.getInstructions();
+
+	context.console.debugPrint();
+	std::cout << "Stopped: " << runner.getStopReason() << "\n"
+		<< "Instructions: " << executed << "\n"
+		<< "Time: " << seconds * 1000 << " ms\n"
+		<< "MIPS: " << (seconds > 0 ? executed / seconds / 1e6 : 0) << std::endl;
+}
+
+// Runs many machines in turbo mode on a pool of worker threads
+void hostLoop(Options const & options, Floppy const & bootDisk) {
+	// Quanta of a few ticks keep the scheduling overhead low while
+	// leaving enough of them to balance the load
+	constexpr unsigned ticksPerQuantum = 4;
+
+	unsigned threads = options.hostThreads;
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	Host host(threads, ticksPerQuantum);
+
+	std::vector<uint8_t> const input = loadInput(options);
+	BatchRunner::Limits const limits = batchLimits(options, BatchRunner::Clock::now());
+
+	// The machines start out identical, so only the first one boots or
+	// restores and the others fork it, sharing its memory and disk
+	Context & first = host.addMachine(input, limits);
+	if (!configureMachine(first, options, bootDisk)) {
+		warnNoJit();
+	}
+	for (unsigned long i = 1; i < options.hostMachines; ++i) {
+		host.forkMachine(first, input, limits);
+	}
+
+	host.run();
+	host.printReport(std::cout);
+}
+
+void windowLoop(Context & context, Options const & options, InputLog * recorder) {
 	// Create main window
-	context.window.create(
+	sf::RenderWindow window;
+	window.create(
 		sf::VideoMode(screenWidth*screenScale, screenHeight*screenScale, 32),
 		"EForthPC");
 
 	// Make sure rendering is done in a 350x230 point space
-	auto view = context.window.getView();
+	auto view = window.getView();
 	view.reset(sf::FloatRect(0, 0, screenWidth, screenHeight));
-	context.window.setView(view);
+	window.setView(view);
 
 	if (useVsync) {
-		context.window.setVerticalSyncEnabled(true);
+		window.setVerticalSyncEnabled(true);
 	} else {
-		context.window.setFramerateLimit(framerateLimit);
+		window.setFramerateLimit(framerateLimit);
 	}
 
-	mainLoop(context);
+	mainLoop(context, window, options, recorder);
+}
+
+int main(int argc, char * argv[]) {
+	std::vector<std::string> const arguments(argv, argv + argc);
+	Options options;
+	if (!parseArguments(arguments, options)) {
+		printUsage(arguments[0]);
+		std::exit(1);
+	}
+
+	if (options.writeBack && (options.diskImage.empty() || !options.restoreFile.empty())) {
+		std::cout << "--write-back needs a disk image and no --restore" << std::endl;
+		std::exit(1);
+	}
+
+	Floppy bootDisk;
+	if (!options.diskImage.empty()) {
+		bootDisk = Floppy::open(options.diskImage, options.writeBack);
+	}
+
+	if (options.hostMachines != 0) {
+		if (!options.saveFile.empty()) {
+			std::cout << "Snapshots cannot be saved in host mode" << std::endl;
+			std::exit(1);
+		}
+		if (!options.profileFile.empty() || !options.traceFile.empty()) {
+			std::cout << "Machines cannot be profiled or traced in host mode" << std::endl;
+			std::exit(1);
+		}
+		if (!options.recordFile.empty() || !options.replayFile.empty()) {
+			std::cout << "Input cannot be recorded or replayed in host mode" << std::endl;
+			std::exit(1);
+		}
+		if (options.writeBack) {
+			std::cout << "Disks cannot be written back in host mode" << std::endl;
+			std::exit(1);
+		}
+		if (options.terminal) {
+			std::cout << "--terminal cannot be used in host mode" << std::endl;
+			std::exit(1);
+		}
+
+		hostLoop(options, bootDisk);
+		return 0;
+	}
+
+	if (options.terminal) {
+		if (options.turbo) {
+			std::cout << "--terminal cannot be used in turbo mode" << std::endl;
+			std::exit(1);
+		}
+		if (!TerminalInput::isSupported()) {
+			std::cout << "--terminal is not supported on this host" << std::endl;
+			std::exit(1);
+		}
+	}
+
+	std::unique_ptr<InputLog> replay;
+	if (!options.replayFile.empty()) {
+		if (!options.turbo || !options.inputFile.empty()) {
+			std::cout << "--replay needs --turbo and replaces --input" << std::endl;
+			std::exit(1);
+		}
+		replay.reset(new InputLog(InputLog::load(options.replayFile)));
+	}
+
+	// Configure RedBus network
+	Context context(consoleAddress, floppyDriveAddress, processorAddress, memoryBankCount);
+	if (!configureMachine(context, options, bootDisk)) {
+		warnNoJit();
+	}
+	if (replay) {
+		// Ticks must run as many cycles as they did when recording
+		context.processor.setClock(replay->getCyclesPerTick(), replay->getClockMode());
+		context.processor.setDeviceSwitchYields(replay->getDeviceSwitchYields());
+	}
+
+	std::unique_ptr<InputLog> recorder;
+	if (!options.recordFile.empty()) {
+		recorder.reset(new InputLog());
+	}
+
+	// Warm boot the 65EL02
+	// context.processor.warmBoot();
+
+#ifdef SIGUSR1
+	if (!options.profileFile.empty() || !options.traceFile.empty()) {
+		std::signal(SIGUSR1, requestDump);
+	}
+#endif
+
+	if (options.turbo) {
+		turboLoop(context, options, replay.get(), recorder.get());
+	} else if (options.terminal) {
+		std::signal(SIGINT, requestStop);
+		std::signal(SIGTERM, requestStop);
+		terminalLoop(context, options, recorder.get());
+	} else {
+		windowLoop(context, options, recorder.get());
+	}
+
+	if (recorder) {
+		recorder->save(options.recordFile);
+	}
+
+	context.drive.syncDisk();
+
+	if (!options.saveFile.empty()) {
+		saveSnapshot(context, options.saveFile);
+	}
+	writeDump(context, options);
 
 	return 0;
 }
@@ -0,0 +1,89 @@
+// Converts raw disk images to packed ones and back. See docs/disk.md.
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/FileUtil.h"
+#include "computer/PackedImage.h"
+
+namespace {
+
+void printUsage(std::string const & program)
+{
+	std::cout << "Usage:\n     " << program << " [options] <input> <output>\n"
+		<< "\n"
+		<< "Packs a raw disk image, or unpacks a packed one.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "     --unpack   Unpack input to a raw image"
+		<< std::endl;
+}
+
+PackedImage loadPacked(std::vector<uint8_t> const & file)
+{
+	std::shared_ptr<uint8_t> data(new uint8_t[file.size()], std::default_delete<uint8_t[]>());
+	std::copy(file.begin(), file.end(), data.get());
+
+	return PackedImage(data, file.size());
+}
+
+}
+
+int main(int argc, char * argv[]) {
+	std::vector<std::string> const arguments(argv, argv + argc);
+
+	bool unpack = false;
+	std::vector<std::string> files;
+
+	for (std::size_t i = 1; i < arguments.size(); ++i) {
+		if (arguments[i] == "--unpack") {
+			unpack = true;
+		} else if (files.size() < 2 && arguments[i][0] != '-') {
+			files.push_back(arguments[i]);
+		} else {
+			printUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	if (files.size() != 2) {
+		printUsage(arguments[0]);
+		return 1;
+	}
+
+	try {
+		std::vector<uint8_t> const input = loadFile(files[0]);
+
+		if (unpack) {
+			saveFile(files[1], loadPacked(input).unpack());
+			return 0;
+		}
+
+		if (PackedImage::isPacked(input.data(), input.size())) {
+			std::cout << files[0] << " is packed already" << std::endl;
+			return 1;
+		}
+
+		std::vector<uint8_t> const output = PackedImage::pack(input);
+		saveFile(files[1], output);
+
+		PackedImage const packed = loadPacked(output);
+		uint32_t zero = 0;
+		for (uint32_t sector = 0; sector < packed.getSectorCount(); ++sector) {
+			zero += packed.getPayload(sector) == 0;
+		}
+
+		std::cout << packed.getSectorCount() << " sectors, " << zero << " zero, "
+			<< packed.getSectorCount() - zero - packed.getPayloadCount() << " duplicate\n"
+			<< input.size() << " bytes packed to " << output.size() << std::endl;
+	} catch (std::exception const & e) {
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+// Prints an execution trace written by eforthpc --trace as text, one
+// record per line, oldest first. See docs/trace.md.
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "computer/Tracer.h"
+
+namespace {
+
+struct Hex {
+	unsigned value;
+	int width;
+};
+
+std::ostream & operator<<(std::ostream & out, Hex hex)
+{
+	return out << std::hex << std::setfill('0') << std::setw(hex.width) << hex.value
+		<< std::dec << std::setfill(' ');
+}
+
+Hex hex8(unsigned value) { return {value, 2}; }
+Hex hex16(unsigned value) { return {value, 4}; }
+
+// E, then the 65C816 status register from bit 7 down, '.' when clear
+std::string flagString(uint16_t flags)
+{
+	char const names[] = "CZIDXMVNE";
+	std::string text;
+	for (int bit = 8; bit >= 0; --bit) {
+		text += flags & 1 << bit ? names[bit] : '.';
+	}
+	return text;
+}
+
+void printRecord(std::ostream & out, uint64_t index, Tracer::Record const & record)
+{
+	out << std::setw(12) << index << "  ";
+
+	switch (record.type) {
+	case Tracer::Instruction:
+		out << hex16(record.address) << "  " << hex8(record.value)
+			<< "  A=" << hex16(record.a)
+			<< " X=" << hex16(record.x)
+			<< " Y=" << hex16(record.y)
+			<< " SP=" << hex16(record.sp)
+			<< " R=" << hex16(record.r)
+			<< " I=" << hex16(record.i)
+			<< " " << flagString(record.flags);
+		break;
+	case Tracer::MemoryWrite:
+		out << "        write " << hex16(record.address) << " = " << hex8(record.value);
+		break;
+	case Tracer::RedbusRead:
+		out << "        redbus " << hex8(record.a) << " read  "
+			<< hex16(record.address) << " = " << hex8(record.value);
+		break;
+	case Tracer::RedbusWrite:
+		out << "        redbus " << hex8(record.a) << " write "
+			<< hex16(record.address) << " = " << hex8(record.value);
+		break;
+	default:
+		out << "        unknown record type " << +record.type;
+		break;
+	}
+
+	out << '\n';
+}
+
+void printUsage(std::string const & program)
+{
+	std::cout << "Usage:\n     " << program << " [options] <trace>\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "     --last <n>   Only print the last n records"
+		<< std::endl;
+}
+
+}
+
+int main(int argc, char * argv[]) {
+	std::vector<std::string> const arguments(argv, argv + argc);
+
+	unsigned long last = 0;
+	std::string traceFile;
+
+	for (std::size_t i = 1; i < arguments.size(); ++i) {
+		bool const hasValue = i + 1 < arguments.size();
+
+		if (arguments[i] == "--last" && hasValue) {
+			last = std::strtoul(arguments[++i].c_str(), nullptr, 10);
+			if (last == 0) {
+				printUsage(arguments[0]);
+				return 1;
+			}
+		} else if (traceFile.empty() && arguments[i][0] != '-') {
+			traceFile = arguments[i];
+		} else {
+			printUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	if (traceFile.empty()) {
+		printUsage(arguments[0]);
+		return 1;
+	}
+
+	uint64_t total = 0;
+	std::vector<Tracer::Record> records;
+	try {
+		records = Tracer::load(traceFile, total);
+	} catch (std::exception const & e) {
+		std::cout << traceFile << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cout << "# " << records.size() << " of " << total << " records\n";
+
+	// Records are numbered from the first one the machine made
+	uint64_t const first = total - records.size();
+	std::size_t start = 0;
+	if (last != 0 && last < records.size()) {
+		start = records.size() - last;
+	}
+
+	for (std::size_t i = start; i < records.size(); ++i) {
+		printRecord(std::cout, first + i, records[i]);
+	}
+
+	return 0;
+}